@@ -0,0 +1,323 @@
+#include "../bench.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define main example_main
+#include "../../examples/behavioral/chain_of_responsibility.cpp"
+#undef main
+
+// Example output goes to /dev/null rather than into the results.
+static const bool kQuietLog __attribute__((unused)) =
+    (logging::Sink::getInstance().setOutput(::open("/dev/null", O_WRONLY)),
+     true);
+
+// Pays through a chain of range(0) accounts where only the last one has
+// enough balance, so every payment walks the whole chain.
+static void BM_pay(bench::State& state)
+{
+  std::shared_ptr<Account> head = std::make_shared<Bitcoin>(1e12f);
+  for (std::int64_t i = 1; i < state.range(0); ++i) {
+    std::shared_ptr<Account> account = std::make_shared<Bank>(0);
+    account->setNext(head);
+    head = account;
+  }
+
+  while (state.keepRunning()) {
+    head->pay(1);
+  }
+  state.counters["hops_per_op"] = static_cast<double>(state.range(0));
+}
+BENCHMARK(BM_pay)->Arg(1)->Arg(3)->Arg(16)->Arg(64)->Arg(1024)->Arg(65536);
+
+#ifdef LOGGING_DISABLED
+// The same with every LOG() compiled out, which leaves only the cost of the
+// chain itself. Run from the chain_of_responsibility_nolog build.
+static void BM_payLoggingDisabled(bench::State& state)
+{
+  BM_pay(state);
+}
+BENCHMARK(BM_payLoggingDisabled)
+    ->Arg(1)->Arg(3)->Arg(16)->Arg(64)->Arg(1024)->Arg(65536);
+#endif
+
+// Checks that the router pays with the same account as the chain would,
+// whatever the balances and amounts.
+static void checkRouter(void)
+{
+  bench::Random random;
+  for (std::size_t size : {1, 2, 3, 5, 64, 1000}) {
+    std::shared_ptr<Account> head;
+    std::vector<float> balances(size);
+    for (std::size_t i = size; i-- > 0;) {
+      balances[i] = static_cast<float>((random.next() >> 33) % 100);
+      std::shared_ptr<Account> account = std::make_shared<Bank>(balances[i]);
+      account->setNext(head);
+      head = account;
+    }
+
+    PaymentRouter router(head);
+    assert(router.getSize() == size);
+    for (std::size_t payment = 0; payment < 10 * size; ++payment) {
+      float amount = static_cast<float>((random.next() >> 33) % 120);
+      std::size_t first = std::find_if(
+          balances.begin(), balances.end(),
+          [amount](float balance) { return balance >= amount; }) -
+          balances.begin();
+
+      Account* account = router.pay(amount);
+      if (first == size) {
+        assert(!account);
+      } else {
+        assert(account == &router.getAccount(first));
+        balances[first] -= amount;
+      }
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+      assert(router.getAccount(i).getBalance() == balances[i]);
+    }
+  }
+}
+
+// The same chains, routed through a PaymentRouter.
+static void BM_payRouted(bench::State& state)
+{
+  static const bool checked __attribute__((unused)) = (checkRouter(), true);
+
+  std::shared_ptr<Account> head = std::make_shared<Bitcoin>(1e12f);
+  for (std::int64_t i = 1; i < state.range(0); ++i) {
+    std::shared_ptr<Account> account = std::make_shared<Bank>(0);
+    account->setNext(head);
+    head = account;
+  }
+
+  PaymentRouter router(head);
+  while (state.keepRunning()) {
+    bench::doNotOptimize(router.pay(1));
+  }
+}
+BENCHMARK(BM_payRouted)
+    ->Arg(1)->Arg(3)->Arg(16)->Arg(64)->Arg(1024)->Arg(65536);
+
+// Pays silently through a runtime chain of range(0) accounts where only the
+// last one has enough balance.
+static void BM_tryPay(bench::State& state)
+{
+  std::shared_ptr<Account> head = std::make_shared<Bitcoin>(1e12f);
+  for (std::int64_t i = 1; i < state.range(0); ++i) {
+    std::shared_ptr<Account> account = std::make_shared<Bank>(0);
+    account->setNext(head);
+    head = account;
+  }
+
+  while (state.keepRunning()) {
+    bench::doNotOptimize(head->tryPay(1));
+  }
+}
+BENCHMARK(BM_tryPay)->Arg(3)->Arg(16)->Arg(64);
+
+// The same through a Chain<Bank, ..., Bank, Bitcoin> of `Length` accounts.
+template <std::size_t, typename T>
+using Repeat = T;
+
+template <std::size_t... Indices>
+static void tryPayStatic(bench::State& state, std::index_sequence<Indices...>)
+{
+  Chain<Repeat<Indices, Bank>..., Bitcoin> chain(
+      (static_cast<void>(Indices), 0.0f)..., 1e12f);
+  while (state.keepRunning()) {
+    bench::doNotOptimize(chain.tryPay(1));
+  }
+}
+
+template <std::size_t Length>
+static void BM_tryPayStatic(bench::State& state)
+{
+  tryPayStatic(state, std::make_index_sequence<Length - 1>());
+}
+BENCHMARK(BM_tryPayStatic<3>);
+BENCHMARK(BM_tryPayStatic<16>);
+BENCHMARK(BM_tryPayStatic<64>);
+
+// Checks that threads paying through the same chain at once spend exactly
+// what the accounts hold, and never more.
+static void checkConcurrentPayments(void)
+{
+  std::shared_ptr<Account> shared = std::make_shared<Bank>(1000);
+  shared->setNext(std::make_shared<Paypal>(500));
+  std::atomic<int> payments(0);
+  std::vector<std::thread> payers;
+  for (int thread = 0; thread < 4; ++thread) {
+    payers.emplace_back([&shared, &payments]() {
+      while (shared->tryPay(0.25f)) {
+        payments.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (std::thread& payer : payers) {
+    payer.join();
+  }
+  assert(payments.load() == 6000);
+  assert(shared->getCents() == 0 && shared->getNext()->getCents() == 0);
+}
+
+static const std::size_t kPaymentsPerThread = 100000;
+
+// range(0) threads each make kPaymentsPerThread payments through a chain of
+// three accounts whose head can pay for all of them, so every payment is a
+// compare-and-swap on the head's balance.
+static void BM_payConcurrent(bench::State& state)
+{
+  static const bool checked __attribute__((unused)) =
+      (checkConcurrentPayments(), true);
+
+  const std::size_t threads = static_cast<std::size_t>(state.range(0));
+  std::shared_ptr<Account> head = std::make_shared<Bank>(1e12f);
+  std::shared_ptr<Account> paypal = std::make_shared<Paypal>(1e12f);
+  head->setNext(paypal);
+  paypal->setNext(std::make_shared<Bitcoin>(1e12f));
+
+  while (state.keepRunning()) {
+    std::vector<std::thread> payers;
+    for (std::size_t t = 0; t < threads; ++t) {
+      payers.emplace_back([&head]() {
+        for (std::size_t i = 0; i < kPaymentsPerThread; ++i) {
+          bench::doNotOptimize(head->tryPay(1));
+        }
+      });
+    }
+    for (auto& payer : payers) {
+      payer.join();
+    }
+  }
+  state.setItemsProcessed(state.iterations() * threads * kPaymentsPerThread);
+}
+BENCHMARK(BM_payConcurrent)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+// Checks that a batch settles the same payments as taking each from the
+// first accounts with money, in order, when the chain can cover it.
+static void checkSettle(void)
+{
+  bench::Random random;
+  for (std::size_t size : {1, 2, 3, 64}) {
+    std::shared_ptr<Account> head;
+    std::vector<std::int64_t> balances(size);
+    for (std::size_t i = size; i-- > 0;) {
+      balances[i] = static_cast<std::int64_t>((random.next() >> 33) % 10000);
+      std::shared_ptr<Account> account =
+          std::make_shared<Bank>(balances[i] / 100.0f);
+      account->setNext(head);
+      head = account;
+    }
+
+    std::vector<float> amounts(20 * size);
+    std::size_t expected = 0;
+    for (float& amount : amounts) {
+      std::int64_t cents =
+          1 + static_cast<std::int64_t>((random.next() >> 33) % 1999);
+      amount = cents / 100.0f;
+      std::int64_t total = 0;
+      for (std::int64_t balance : balances) {
+        total += balance;
+      }
+      if (cents <= total) {
+        for (std::int64_t& balance : balances) {
+          std::int64_t taken = std::min(balance, cents);
+          balance -= taken;
+          cents -= taken;
+        }
+        ++expected;
+      }
+    }
+
+    std::vector<Charge> charges;
+    const std::size_t paid = head->settle(amounts, charges);
+    assert(paid == expected);
+    std::size_t i = 0;
+    for (Account* account = head.get(); account;
+         account = account->getNext().get()) {
+      assert(account->getCents() == balances[i++]);
+    }
+  }
+}
+
+// Pays range(0) random amounts between 0.01 and 1 through a fresh chain of
+// range(1) accounts holding 1e4 each, one pay() call at a time (range(2) ==
+// 0), one tryPay() call at a time (1) or as one settle() batch (2). The
+// accounts at the head run dry along the way, so single payments walk ever
+// further down the chain.
+static void BM_settle(bench::State& state)
+{
+  static const bool checked __attribute__((unused)) = (checkSettle(), true);
+
+  std::vector<float> amounts(static_cast<std::size_t>(state.range(0)));
+  bench::Random random;
+  for (float& amount : amounts) {
+    std::uint64_t seed = random.next();
+    amount = ((seed >> 33) % 100 + 1) / 100.0f;
+  }
+
+  std::vector<Charge> charges;
+  while (state.keepRunning()) {
+    state.pauseTiming();
+    std::shared_ptr<Account> head;
+    for (std::int64_t i = 0; i < state.range(1); ++i) {
+      std::shared_ptr<Account> account = std::make_shared<Bank>(1e4f);
+      account->setNext(head);
+      head = account;
+    }
+    charges.clear();
+    state.resumeTiming();
+
+    if (state.range(2) == 0) {
+      for (float amount : amounts) {
+        head->pay(amount);
+      }
+    } else if (state.range(2) == 1) {
+      for (float amount : amounts) {
+        bench::doNotOptimize(head->tryPay(amount));
+      }
+    } else {
+      bench::doNotOptimize(head->settle(amounts, charges));
+    }
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_settle)
+    ->Args({1000000, 64, 0})->Args({1000000, 64, 1})->Args({1000000, 64, 2});
+
+// The cost of writing one "Paid ..." line the way the examples used to, with
+// std::endl on a stream backed by a real file (range(0) == 0), and through
+// the logging sink, including the flusher's work on this single core (1) or
+// only what the caller pays, flushing between rounds of 256 lines (2).
+static void BM_logLine(bench::State& state)
+{
+  std::ofstream file("/dev/null");
+  std::string name = "bitcoin";
+  float amount = 250;
+  std::int64_t lines = 0;
+  while (state.keepRunning()) {
+    if (state.range(0) == 0) {
+      file << "Paid " << amount << " using " << name << "." << std::endl;
+    } else {
+      LOG("Paid ", amount, " using ", name, ".");
+    }
+    if (state.range(0) == 2 && ++lines % 256 == 0) {
+      state.pauseTiming();
+      logging::Sink::getInstance().flush();
+      state.resumeTiming();
+    }
+  }
+  logging::Sink::getInstance().flush();
+}
+BENCHMARK(BM_logLine)->Arg(0)->Arg(1)->Arg(2);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,328 @@
+#include "../bench.h"
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define main example_main
+#include "../../examples/behavioral/command.cpp"
+#undef main
+
+// Example output goes to /dev/null rather than into the results.
+static const bool kQuietLog __attribute__((unused)) =
+    (logging::Sink::getInstance().setOutput(::open("/dev/null", O_WRONLY)),
+     true);
+
+static void BM_submit(bench::State& state)
+{
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  std::shared_ptr<TurnOn> turnOn = std::make_shared<TurnOn>(bulb);
+  std::shared_ptr<TurnOff> turnOff = std::make_shared<TurnOff>(bulb);
+
+  RemoteControl remote;
+  while (state.keepRunning()) {
+    remote.submit(turnOn);
+    remote.submit(turnOff);
+  }
+  state.setItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_submit);
+
+#ifdef LOGGING_DISABLED
+// The same with every LOG() compiled out. Run from the command_nolog build.
+static void BM_submitLoggingDisabled(bench::State& state)
+{
+  BM_submit(state);
+}
+BENCHMARK(BM_submitLoggingDisabled);
+#endif
+
+// Creating a command for every submission, as a shared_ptr<Command> ...
+static void BM_submitNewShared(bench::State& state)
+{
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  RemoteControl remote;
+  while (state.keepRunning()) {
+    remote.submit(std::make_shared<TurnOn>(bulb));
+    remote.submit(std::make_shared<TurnOff>(bulb));
+  }
+  state.setItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_submitNewShared);
+
+// ... and as an InlineCommand.
+static void BM_submitNewInline(bench::State& state)
+{
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  RemoteControl remote;
+  while (state.keepRunning()) {
+    remote.submit(InlineCommand(TurnOn(bulb)));
+    remote.submit(InlineCommand(TurnOff(bulb)));
+  }
+  state.setItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_submitNewInline);
+
+// range(0) random TurnOn and TurnOff commands over range(1) bulbs, submitted
+// one by one (range(2) == 0) or as a single batch (range(2) == 1).
+static void BM_submitBatch(bench::State& state)
+{
+  std::vector<std::shared_ptr<Command>> turnOns;
+  std::vector<std::shared_ptr<Command>> turnOffs;
+  for (std::int64_t i = 0; i < state.range(1); ++i) {
+    std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+    turnOns.push_back(std::make_shared<TurnOn>(bulb));
+    turnOffs.push_back(std::make_shared<TurnOff>(bulb));
+  }
+
+  std::vector<std::shared_ptr<Command>> commands;
+  bench::Random random;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    std::uint64_t seed = random.next();
+    std::size_t bulb = (seed >> 33) % turnOns.size();
+    commands.push_back((seed >> 20) & 1 ? turnOns[bulb] : turnOffs[bulb]);
+  }
+
+  // The first batch sizes the scratch space that later ones reuse.
+  RemoteControl remote;
+  if (state.range(2)) {
+    remote.submitBatch(commands);
+  }
+  while (state.keepRunning()) {
+    if (state.range(2)) {
+      remote.submitBatch(commands);
+    } else {
+      for (const auto& command : commands) {
+        remote.submit(command);
+      }
+    }
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_submitBatch)
+    ->Args({1000000, 1000, 0})->Args({1000000, 1000, 1});
+
+static const std::size_t kCommandsPerProducer = 20000;
+
+// range(0) producers submit kCommandsPerProducer commands each to an
+// AsyncRemoteControl with a queue of range(1) commands and the backpressure
+// policy range(2). Every iteration waits for the worker to catch up, and the
+// latency of every submit call is recorded.
+static void BM_submitAsync(bench::State& state)
+{
+  typedef std::chrono::steady_clock clock_t;
+  const std::size_t producers = static_cast<std::size_t>(state.range(0));
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  std::shared_ptr<Command> turnOn = std::make_shared<TurnOn>(bulb);
+  AsyncRemoteControl remote(static_cast<std::size_t>(state.range(1)),
+                            static_cast<Backpressure>(state.range(2)));
+
+  // Only the latencies of the last iteration are kept.
+  std::vector<std::vector<float>> latencies(producers);
+  for (auto& latency : latencies) {
+    latency.reserve(kCommandsPerProducer);
+  }
+  while (state.keepRunning()) {
+    state.pauseTiming();
+    for (auto& latency : latencies) {
+      latency.clear();
+    }
+    state.resumeTiming();
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&, p]() {
+        std::vector<float>& latency = latencies[p];
+        for (std::size_t i = 0; i < kCommandsPerProducer; ++i) {
+          clock_t::time_point start = clock_t::now();
+          remote.submit(turnOn);
+          latency.push_back(std::chrono::duration<float, std::nano>(
+              clock_t::now() - start).count());
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    remote.drain();
+  }
+  state.setItemsProcessed(state.iterations() * producers *
+                          kCommandsPerProducer);
+
+  std::vector<float> all;
+  for (auto& latency : latencies) {
+    all.insert(all.end(), latency.begin(), latency.end());
+  }
+  std::sort(all.begin(), all.end());
+  state.counters["enqueue_p50_ns"] = all[all.size() / 2];
+  state.counters["enqueue_p99_ns"] = all[all.size() * 99 / 100];
+  state.counters["enqueue_p999_ns"] = all[all.size() * 999 / 1000];
+  state.counters["dropped"] = static_cast<double>(remote.getDroppedCount());
+}
+BENCHMARK(BM_submitAsync)
+    ->Args({1, 4096, 0})->Args({16, 4096, 0})
+    ->Args({16, 256, 0})->Args({16, 256, 1});
+
+// Submits range(0) distinct commands to an UndoableRemoteControl big enough
+// to remember all of them, spread over 1000 bulbs so that nothing coalesces,
+// and reports how much memory the history costs per entry.
+static void BM_historyMemory(bench::State& state)
+{
+  const std::size_t commands = static_cast<std::size_t>(state.range(0));
+  std::vector<std::shared_ptr<Bulb>> bulbs;
+  for (int i = 0; i < 1000; ++i) {
+    bulbs.push_back(std::make_shared<Bulb>());
+  }
+
+  double bytesPerEntry = 0;
+  std::size_t historySize = 0;
+  while (state.keepRunning()) {
+    state.pauseTiming();
+    malloc_trim(0);
+    std::size_t before = bench::residentBytes();
+    state.resumeTiming();
+
+    UndoableRemoteControl remote(commands * sizeof(InlineCommand));
+    for (std::size_t i = 0; i < commands; ++i) {
+      remote.submit(TurnOn(bulbs[i % bulbs.size()]));
+    }
+
+    state.pauseTiming();
+    bytesPerEntry = static_cast<double>(bench::residentBytes() - before) /
+        static_cast<double>(commands);
+    historySize = remote.getHistorySize();
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+  state.counters["rss_bytes_per_entry"] = bytesPerEntry;
+  state.counters["ring_bytes_per_entry"] = sizeof(InlineCommand);
+  state.counters["history_size"] = static_cast<double>(historySize);
+}
+BENCHMARK(BM_historyMemory)->Arg(10000000);
+
+// Undoing and redoing in a full history of range(0) commands.
+static void BM_undoRedo(bench::State& state)
+{
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  UndoableRemoteControl remote(state.range(0) * sizeof(InlineCommand));
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    remote.submit(TurnOn(bulb));
+  }
+
+  while (state.keepRunning()) {
+    remote.undo();
+    remote.redo();
+  }
+  state.setItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_undoRedo)->Arg(1000)->Arg(10000000);
+
+// Alternating TurnOn and TurnOff on one bulb, which the history coalesces.
+static void BM_submitCoalescing(bench::State& state)
+{
+  std::shared_ptr<Bulb> bulb = std::make_shared<Bulb>();
+  UndoableRemoteControl remote(1 << 20);
+  while (state.keepRunning()) {
+    remote.submit(TurnOn(bulb));
+    remote.submit(TurnOff(bulb));
+  }
+  state.setItemsProcessed(state.iterations() * 2);
+  state.counters["history_size"] =
+      static_cast<double>(remote.getHistorySize());
+}
+BENCHMARK(BM_submitCoalescing);
+
+// A fresh file for the journals, removed by the benchmark that writes them.
+static std::string makeJournalPath(void)
+{
+  char path[] = "/tmp/command_benchmark.XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd < 0) {
+    throw std::runtime_error("Could not create the journal.");
+  }
+  ::close(fd);
+  return path;
+}
+
+// Random TurnOn and TurnOff commands over 1000 bulbs, repeated to fill
+// journals of any size.
+static std::vector<std::shared_ptr<Command>> makeJournalCommands(
+    const std::vector<std::shared_ptr<Bulb>>& bulbs)
+{
+  std::vector<std::shared_ptr<Command>> commands;
+  bench::Random random;
+  for (std::size_t i = 0; i < 1000000; ++i) {
+    std::uint64_t seed = random.next();
+    std::shared_ptr<Bulb> bulb = bulbs[(seed >> 33) % bulbs.size()];
+    if ((seed >> 20) & 1) {
+      commands.push_back(std::make_shared<TurnOn>(bulb));
+    } else {
+      commands.push_back(std::make_shared<TurnOff>(bulb));
+    }
+  }
+  return commands;
+}
+
+static void writeJournal(const std::string& path,
+                         const std::vector<std::shared_ptr<Bulb>>& bulbs,
+                         const std::vector<std::shared_ptr<Command>>& commands,
+                         std::size_t records, std::size_t syncEvery)
+{
+  ::truncate(path.c_str(), 0);
+  CommandJournal journal(path, bulbs, syncEvery);
+  for (std::size_t i = 0; i < records; ++i) {
+    journal.append(commands[i % commands.size()]->getEffect());
+  }
+}
+
+// Appends range(0) commands (5 bytes each) to a new journal that is synced
+// every range(1) records and once more when closed.
+static void BM_journalAppend(bench::State& state)
+{
+  const std::size_t records = static_cast<std::size_t>(state.range(0));
+  std::vector<std::shared_ptr<Bulb>> bulbs(1000);
+  for (auto& bulb : bulbs) {
+    bulb = std::make_shared<Bulb>();
+  }
+  std::vector<std::shared_ptr<Command>> commands = makeJournalCommands(bulbs);
+  const std::string path = makeJournalPath();
+
+  while (state.keepRunning()) {
+    writeJournal(path, bulbs, commands, records,
+                 static_cast<std::size_t>(state.range(1)));
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+  state.counters["mb_per_second"] =
+      state.iterations() * records * 5.0 / state.seconds() / 1e6;
+  ::unlink(path.c_str());
+}
+BENCHMARK(BM_journalAppend)
+    ->Args({100000, 1})->Args({1000000, 64})
+    ->Args({20000000, 1048576})->Args({20000000, 0});
+
+// Rebuilds the state of 1000 bulbs from a journal of range(0) commands. The
+// journal is in the page cache after being written.
+static void BM_journalReplay(bench::State& state)
+{
+  const std::size_t records = static_cast<std::size_t>(state.range(0));
+  std::vector<std::shared_ptr<Bulb>> bulbs(1000);
+  for (auto& bulb : bulbs) {
+    bulb = std::make_shared<Bulb>();
+  }
+  const std::string path = makeJournalPath();
+  writeJournal(path, bulbs, makeJournalCommands(bulbs), records, 0);
+
+  while (state.keepRunning()) {
+    bench::doNotOptimize(CommandJournal::replay(path, bulbs));
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+  state.counters["mb_per_second"] =
+      state.iterations() * records * 5.0 / state.seconds() / 1e6;
+  ::unlink(path.c_str());
+}
+BENCHMARK(BM_journalReplay)->Arg(1000000)->Arg(20000000);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,497 @@
+// A tiny, header-only microbenchmark harness in the spirit of Google
+// Benchmark. Each benchmark binary is a single translation unit that includes
+// this header once, registers its benchmarks with BENCHMARK() and ends with
+// BENCHMARK_MAIN().
+//
+// Results are written to stdout as JSON Lines (one object per run) so that the
+// output of several binaries can simply be concatenated and diffed between
+// commits. A human readable summary is written to stderr.
+//
+// Command line options:
+//   --filter=<text>     Only run benchmarks whose name contains <text>.
+//   --min_time=<secs>   Minimum measured time per benchmark (default 0.5).
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace bench
+{
+
+// Global allocation counters, fed by the operator new replacements below.
+inline std::atomic<std::uint64_t>& allocationCount(void)
+{
+  static std::atomic<std::uint64_t> count(0);
+  return count;
+}
+
+inline std::atomic<std::uint64_t>& allocatedBytes(void)
+{
+  static std::atomic<std::uint64_t> bytes(0);
+  return bytes;
+}
+
+// The resident set size of the process in bytes, or 0 where /proc is not
+// available.
+inline std::size_t residentBytes(void)
+{
+  std::FILE* statm = std::fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return 0;
+  }
+
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  int read = std::fscanf(statm, "%lu %lu", &size, &resident);
+  std::fclose(statm);
+  long page = sysconf(_SC_PAGESIZE);
+  return read == 2 && page > 0 ? resident * page : 0;
+}
+
+// Keeps the compiler from optimizing away a computed value.
+template <typename T>
+inline void doNotOptimize(T const& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Forces all pending writes to memory to be considered observable.
+inline void clobberMemory(void)
+{
+  asm volatile("" : : : "memory");
+}
+
+// A fast, reproducible source of pseudo-random numbers for building inputs:
+// a 64-bit linear congruential generator. Its high bits are the random ones.
+class Random
+{
+  public:
+    explicit Random(std::uint64_t seed = 42)
+        : state_(seed)
+    {
+    }
+
+    std::uint64_t next(void)
+    {
+      state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+      return state_;
+    }
+
+  private:
+    std::uint64_t state_;
+};
+
+class State
+{
+  public:
+    typedef std::chrono::steady_clock clock_t;
+
+    State(const std::vector<std::int64_t>& args, double minTime)
+        : args_(args), minTime_(minTime), started_(false), running_(false),
+          remaining_(0), batch_(1), iterations_(0), itemsProcessed_(-1),
+          elapsed_(0), allocations_(0), bytes_(0)
+    {
+    }
+
+    // Returns true while the benchmark loop should keep going. Time is only
+    // checked between batches so that the loop itself stays cheap.
+    bool keepRunning(void)
+    {
+      if (remaining_ > 0) {
+        --remaining_;
+        return true;
+      }
+      return nextBatch();
+    }
+
+    std::int64_t range(std::size_t index) const
+    {
+      return index < args_.size() ? args_[index] : 0;
+    }
+
+    std::int64_t iterations(void) const
+    {
+      return iterations_;
+    }
+
+    void pauseTiming(void)
+    {
+      if (running_) {
+        stop();
+      }
+    }
+
+    void resumeTiming(void)
+    {
+      if (!running_) {
+        start();
+      }
+    }
+
+    // The number of logical items handled by the whole run, used to compute
+    // throughput. Defaults to the number of iterations.
+    void setItemsProcessed(std::int64_t items)
+    {
+      itemsProcessed_ = items;
+    }
+
+    double seconds(void) const
+    {
+      return elapsed_ / 1e9;
+    }
+
+    double nanoseconds(void) const
+    {
+      return elapsed_;
+    }
+
+    std::uint64_t allocations(void) const
+    {
+      return allocations_;
+    }
+
+    std::uint64_t bytes(void) const
+    {
+      return bytes_;
+    }
+
+    std::int64_t itemsProcessed(void) const
+    {
+      return itemsProcessed_ < 0 ? iterations_ : itemsProcessed_;
+    }
+
+    // Extra values reported alongside the standard ones (e.g. hit rates).
+    std::map<std::string, double> counters;
+
+  private:
+    bool nextBatch(void)
+    {
+      if (!started_) {
+        started_ = true;
+        start();
+      } else {
+        iterations_ += batch_;
+        if (running_) {
+          stop();
+        }
+        if (elapsed_ >= minTime_ * 1e9) {
+          return false;
+        }
+        // Aim for the remaining time with a bounded growth factor.
+        double perIteration = elapsed_ / iterations_;
+        double wanted = (minTime_ * 1e9 - elapsed_) / (perIteration + 1e-3);
+        std::int64_t next = static_cast<std::int64_t>(wanted * 1.2) + 1;
+        std::int64_t limit = iterations_ * 10;
+        batch_ = next < limit ? next : limit;
+        start();
+      }
+      remaining_ = batch_ - 1;
+      return true;
+    }
+
+    void start(void)
+    {
+      running_ = true;
+      allocationMark_ = allocationCount().load(std::memory_order_relaxed);
+      bytesMark_ = allocatedBytes().load(std::memory_order_relaxed);
+      timeMark_ = clock_t::now();
+    }
+
+    void stop(void)
+    {
+      clock_t::time_point now = clock_t::now();
+      running_ = false;
+      elapsed_ += std::chrono::duration<double, std::nano>(
+          now - timeMark_).count();
+      allocations_ +=
+          allocationCount().load(std::memory_order_relaxed) - allocationMark_;
+      bytes_ += allocatedBytes().load(std::memory_order_relaxed) - bytesMark_;
+    }
+
+    std::vector<std::int64_t> args_;
+    double minTime_;
+    bool started_;
+    bool running_;
+    std::int64_t remaining_;
+    std::int64_t batch_;
+    std::int64_t iterations_;
+    std::int64_t itemsProcessed_;
+    double elapsed_;
+    std::uint64_t allocations_;
+    std::uint64_t bytes_;
+    std::uint64_t allocationMark_;
+    std::uint64_t bytesMark_;
+    clock_t::time_point timeMark_;
+};
+
+typedef void (*function_t)(State&);
+
+class Benchmark
+{
+  public:
+    Benchmark(const std::string& name, function_t function)
+        : name_(name), function_(function)
+    {
+    }
+
+    Benchmark* Arg(std::int64_t arg)
+    {
+      argSets_.push_back(std::vector<std::int64_t>(1, arg));
+      return this;
+    }
+
+    Benchmark* Args(const std::vector<std::int64_t>& args)
+    {
+      argSets_.push_back(args);
+      return this;
+    }
+
+    // Adds every power of `multiplier` in [first, last] as an argument.
+    Benchmark* Range(std::int64_t first, std::int64_t last,
+                     std::int64_t multiplier = 8)
+    {
+      for (std::int64_t arg = first; arg < last; arg *= multiplier) {
+        Arg(arg);
+      }
+      return Arg(last);
+    }
+
+    const std::string& name(void) const
+    {
+      return name_;
+    }
+
+    function_t function(void) const
+    {
+      return function_;
+    }
+
+    std::vector<std::vector<std::int64_t>> argSets(void) const
+    {
+      if (argSets_.empty()) {
+        return std::vector<std::vector<std::int64_t>>(1);
+      }
+      return argSets_;
+    }
+
+  private:
+    std::string name_;
+    function_t function_;
+    std::vector<std::vector<std::int64_t>> argSets_;
+};
+
+inline std::vector<Benchmark*>& registry(void)
+{
+  static std::vector<Benchmark*> benchmarks;
+  return benchmarks;
+}
+
+inline Benchmark* registerBenchmark(const char* name, function_t function)
+{
+  registry().push_back(new Benchmark(name, function));
+  return registry().back();
+}
+
+// Swallows everything the examples print so that only the pattern itself is
+// measured and stdout stays machine readable.
+class NullBuffer : public std::streambuf
+{
+  protected:
+    int overflow(int c)
+    {
+      return c == EOF ? 0 : c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count)
+    {
+      return count;
+    }
+};
+
+inline std::string runName(const Benchmark& benchmark,
+                           const std::vector<std::int64_t>& args)
+{
+  std::string name = benchmark.name();
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    name += "/" + std::to_string(args[i]);
+  }
+  return name;
+}
+
+inline void report(const std::string& name, const State& state)
+{
+  // A benchmark that never entered its loop has nothing to divide by, and
+  // NaN is not valid JSON.
+  double iterations = state.iterations() > 0
+      ? static_cast<double>(state.iterations()) : 1;
+  double nsPerOp = state.nanoseconds() / iterations;
+  double allocsPerOp = state.allocations() / iterations;
+  double bytesPerOp = state.bytes() / iterations;
+  double itemsPerSecond = state.seconds() > 0
+      ? state.itemsProcessed() / state.seconds() : 0;
+
+  std::printf("{\"name\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.3f,"
+              "\"allocs_per_op\":%.3f,\"bytes_per_op\":%.3f,"
+              "\"items_per_second\":%.3f",
+              name.c_str(), static_cast<long long>(state.iterations()),
+              nsPerOp, allocsPerOp, bytesPerOp, itemsPerSecond);
+  std::map<std::string, double>::const_iterator counter;
+  for (counter = state.counters.begin(); counter != state.counters.end();
+       ++counter) {
+    std::printf(",\"%s\":%.15g", counter->first.c_str(), counter->second);
+  }
+  std::printf("}\n");
+  std::fflush(stdout);
+
+  std::fprintf(stderr, "%-48s %14.2f ns/op %10.2f allocs/op %14.0f items/s\n",
+               name.c_str(), nsPerOp, allocsPerOp, itemsPerSecond);
+}
+
+inline int runAll(int argc, char** argv)
+{
+  std::string filter;
+  double minTime = 0.5;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (std::strncmp(argv[i], "--min_time=", 11) == 0) {
+      minTime = std::atof(argv[i] + 11);
+    } else {
+      std::fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  NullBuffer nullBuffer;
+  std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+  std::streambuf* cerrBuffer = std::cerr.rdbuf(&nullBuffer);
+
+  for (std::size_t i = 0; i < registry().size(); ++i) {
+    const Benchmark& benchmark = *registry()[i];
+    std::vector<std::vector<std::int64_t>> argSets = benchmark.argSets();
+    for (std::size_t j = 0; j < argSets.size(); ++j) {
+      std::string name = runName(benchmark, argSets[j]);
+      if (name.find(filter) == std::string::npos) {
+        continue;
+      }
+      State state(argSets[j], minTime);
+      benchmark.function()(state);
+      report(name, state);
+    }
+  }
+
+  std::cout.rdbuf(coutBuffer);
+  std::cerr.rdbuf(cerrBuffer);
+  return 0;
+}
+
+} // namespace bench
+
+// Every allocation made by a benchmark binary goes through these, which lets
+// us report allocations per operation. They are kept out of line so that the
+// compiler never pairs an inlined free() with a builtin new expression.
+__attribute__((noinline)) void* operator new(std::size_t size)
+{
+  bench::allocationCount().fetch_add(1, std::memory_order_relaxed);
+  bench::allocatedBytes().fetch_add(size, std::memory_order_relaxed);
+  void* memory = std::malloc(size ? size : 1);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+__attribute__((noinline)) void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+// Types aligned beyond __STDCPP_DEFAULT_NEW_ALIGNMENT__ (e.g. alignas(64))
+// come through these instead.
+__attribute__((noinline)) void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  bench::allocationCount().fetch_add(1, std::memory_order_relaxed);
+  bench::allocatedBytes().fetch_add(size, std::memory_order_relaxed);
+  // aligned_alloc() wants a size that is a multiple of the alignment.
+  std::size_t align = static_cast<std::size_t>(alignment);
+  std::size_t rounded = ((size ? size : 1) + align - 1) / align * align;
+  void* memory = std::aligned_alloc(align, rounded);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+__attribute__((noinline)) void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory, std::size_t) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept
+{
+  std::free(memory);
+}
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+
+#define BENCHMARK(function)                                                  \
+  static bench::Benchmark* BENCH_CONCAT(benchmark_, __LINE__)                 \
+      __attribute__((unused)) = bench::registerBenchmark(#function, function)
+
+#define BENCHMARK_MAIN()                                                     \
+  int main(int argc, char** argv)                                            \
+  {                                                                          \
+    return bench::runAll(argc, argv);                                        \
+  }
+
+#endif // BENCH_H
@@ -0,0 +1,20 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/abstract_factory.cpp"
+#undef main
+
+static void BM_makeDoorAndExpert(bench::State& state)
+{
+  WoodenDoorFactory woodenFactory;
+  DoorFactory& factory = woodenFactory;
+  while (state.keepRunning()) {
+    std::shared_ptr<Door> door = factory.makeDoor();
+    std::shared_ptr<DoorFittingExpert> expert = factory.makeFittingExpert();
+    bench::doNotOptimize(door.get());
+    bench::doNotOptimize(expert.get());
+  }
+}
+BENCHMARK(BM_makeDoorAndExpert);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,21 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/builder.cpp"
+#undef main
+
+static void BM_build(bench::State& state)
+{
+  while (state.keepRunning()) {
+    std::shared_ptr<Burger> burger = BurgerBuilder(3).
+        addPepperoni().
+        addCheese().
+        addLettuce().
+        addTomato().
+        build();
+    bench::doNotOptimize(burger.get());
+  }
+}
+BENCHMARK(BM_build);
+
+BENCHMARK_MAIN()
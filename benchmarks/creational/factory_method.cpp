@@ -0,0 +1,16 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/factory_method.cpp"
+#undef main
+
+static void BM_takeInterview(bench::State& state)
+{
+  DevelopmentManager developmentManager;
+  while (state.keepRunning()) {
+    developmentManager.takeInterview();
+  }
+}
+BENCHMARK(BM_takeInterview);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,18 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/prototype.cpp"
+#undef main
+
+static void BM_clone(bench::State& state)
+{
+  Sheep original = Sheep("Molly", "Mountain Sheep");
+  while (state.keepRunning()) {
+    Sheep clone = original;
+    clone.setName("Dolly");
+    bench::doNotOptimize(clone);
+  }
+}
+BENCHMARK(BM_clone);
+
+BENCHMARK_MAIN()
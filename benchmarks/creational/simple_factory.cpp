@@ -0,0 +1,16 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/simple_factory.cpp"
+#undef main
+
+static void BM_makeDoor(bench::State& state)
+{
+  while (state.keepRunning()) {
+    std::shared_ptr<Door> door = DoorFactory::makeDoor(100, 200);
+    bench::doNotOptimize(door->getWidth());
+  }
+}
+BENCHMARK(BM_makeDoor);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,16 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/creational/singleton.cpp"
+#undef main
+
+static void BM_getInstance(bench::State& state)
+{
+  while (state.keepRunning()) {
+    President& president = President::getInstance();
+    bench::doNotOptimize(&president);
+  }
+}
+BENCHMARK(BM_getInstance);
+
+BENCHMARK_MAIN()
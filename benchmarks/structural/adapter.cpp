@@ -0,0 +1,114 @@
+#include "../bench.h"
+
+#include <random>
+
+#define main example_main
+#include "../../examples/structural/adapter.cpp"
+#undef main
+
+static void BM_huntLion(bench::State& state)
+{
+  AfricanLion lion;
+  Hunter hunter;
+  while (state.keepRunning()) {
+    hunter.hunt(lion);
+  }
+}
+BENCHMARK(BM_huntLion);
+
+static void BM_huntWildDogAdapter(bench::State& state)
+{
+  WildDogAdapter wildDogAdapter(std::make_shared<WildDog>());
+  Hunter hunter;
+  while (state.keepRunning()) {
+    hunter.hunt(wildDogAdapter);
+  }
+}
+BENCHMARK(BM_huntWildDogAdapter);
+
+static void BM_huntStaticWildDogAdapter(bench::State& state)
+{
+  StaticWildDogAdapter<WildDog> wildDogAdapter;
+  Hunter hunter;
+  while (state.keepRunning()) {
+    hunter.hunt(wildDogAdapter);
+  }
+}
+BENCHMARK(BM_huntStaticWildDogAdapter);
+
+static const std::size_t kPackSize = 10000000;
+
+// The kind of each animal of the pack, shuffled so that the hunter cannot
+// guess the next one.
+static std::vector<unsigned char> makeKinds(void)
+{
+  std::vector<unsigned char> kinds(kPackSize);
+  std::mt19937 random(42);
+  for (std::size_t i = 0; i < kinds.size(); ++i) {
+    kinds[i] = static_cast<unsigned char>(random() % 3);
+  }
+  return kinds;
+}
+
+// A pack of lions and adapted wild dogs, each allocated on its own and
+// hunted through the Lion interface. Lion has no virtual destructor, so the
+// pack holds shared_ptrs made for the concrete types, which delete them right.
+static void BM_huntPackVirtual(bench::State& state)
+{
+  std::shared_ptr<WildDog> wildDog = std::make_shared<WildDog>();
+  std::vector<unsigned char> kinds = makeKinds();
+  std::vector<std::shared_ptr<Lion>> pack;
+  pack.reserve(kinds.size());
+  for (unsigned char kind : kinds) {
+    if (kind == 0) {
+      pack.push_back(std::make_shared<AfricanLion>());
+    } else if (kind == 1) {
+      pack.push_back(std::make_shared<AsianLion>());
+    } else {
+      pack.push_back(std::make_shared<WildDogAdapter>(wildDog));
+    }
+  }
+
+  Hunter hunter;
+  while (state.keepRunning()) {
+    for (std::shared_ptr<Lion>& lion : pack) {
+      hunter.hunt(*lion);
+    }
+  }
+  state.setItemsProcessed(state.iterations() * pack.size());
+}
+BENCHMARK(BM_huntPackVirtual);
+
+// The same pack kept in one vector of variants, with the dogs behind the
+// virtual adapter or behind the static one.
+template <typename Adapter>
+static void BM_huntPackVariant(bench::State& state)
+{
+  std::shared_ptr<WildDog> wildDog = std::make_shared<WildDog>();
+  std::vector<unsigned char> kinds = makeKinds();
+  std::vector<std::variant<AfricanLion, AsianLion, Adapter>> pack;
+  pack.reserve(kinds.size());
+  for (unsigned char kind : kinds) {
+    if (kind == 0) {
+      pack.emplace_back(AfricanLion());
+    } else if (kind == 1) {
+      pack.emplace_back(AsianLion());
+    } else {
+      if constexpr (std::is_polymorphic<Adapter>::value) {
+        pack.emplace_back(Adapter(wildDog));
+      } else {
+        pack.emplace_back(Adapter(*wildDog));
+      }
+    }
+  }
+
+  Hunter hunter;
+  while (state.keepRunning()) {
+    bench::doNotOptimize(hunter.hunt(pack));
+  }
+  state.setItemsProcessed(state.iterations() * pack.size());
+}
+BENCHMARK(BM_huntPackVariant<WildDogAdapter>);
+BENCHMARK(BM_huntPackVariant<StaticWildDogAdapter<WildDog>>);
+
+BENCHMARK_MAIN()
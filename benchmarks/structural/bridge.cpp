@@ -0,0 +1,147 @@
+#include "../bench.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#define main example_main
+#include "../../examples/structural/bridge.cpp"
+#undef main
+
+static void BM_getContent(bench::State& state)
+{
+  std::shared_ptr<Theme> themes[] = {
+    std::make_shared<DarkTheme>(),
+    std::make_shared<LightTheme>(),
+    std::make_shared<AquaTheme>()
+  };
+  std::vector<std::shared_ptr<WebPage>> pages;
+  for (int i = 0; i < 3; ++i) {
+    pages.push_back(std::make_shared<About>(themes[i]));
+    pages.push_back(std::make_shared<Projects>(themes[i]));
+    pages.push_back(std::make_shared<Careers>(themes[i]));
+  }
+
+  std::size_t next = 0;
+  while (state.keepRunning()) {
+    std::string content = pages[next]->getContent();
+    bench::doNotOptimize(content);
+    next = next + 1 == pages.size() ? 0 : next + 1;
+  }
+}
+BENCHMARK(BM_getContent);
+
+// Every kind of page in every theme.
+static std::vector<std::shared_ptr<WebPage>> makeSite(void)
+{
+  std::shared_ptr<Theme> themes[] = {
+    std::make_shared<DarkTheme>(),
+    std::make_shared<LightTheme>(),
+    std::make_shared<AquaTheme>()
+  };
+  std::vector<std::shared_ptr<WebPage>> pages;
+  for (int i = 0; i < 3; ++i) {
+    pages.push_back(std::make_shared<About>(themes[i]));
+    pages.push_back(std::make_shared<Projects>(themes[i]));
+    pages.push_back(std::make_shared<Careers>(themes[i]));
+  }
+  return pages;
+}
+
+// Which page each request asks for, in a random order.
+static std::vector<std::size_t> makeRequests(std::size_t pages)
+{
+  std::vector<std::size_t> requests(4096);
+  std::mt19937 random(42);
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    requests[i] = random() % pages;
+  }
+  return requests;
+}
+
+static void BM_serveUncached(bench::State& state)
+{
+  std::vector<std::shared_ptr<WebPage>> pages = makeSite();
+  std::vector<std::size_t> requests = makeRequests(pages.size());
+  std::size_t next = 0;
+  while (state.keepRunning()) {
+    std::string content = pages[requests[next]]->getContent();
+    bench::doNotOptimize(content);
+    next = (next + 1) % requests.size();
+  }
+}
+BENCHMARK(BM_serveUncached);
+
+static void BM_serveCached(bench::State& state)
+{
+  std::vector<std::shared_ptr<WebPage>> pages = makeSite();
+  std::vector<std::size_t> requests = makeRequests(pages.size());
+  RenderCache cache;
+  std::size_t next = 0;
+  while (state.keepRunning()) {
+    RenderCache::content_t content = cache.getContent(*pages[requests[next]]);
+    bench::doNotOptimize(content);
+    next = (next + 1) % requests.size();
+  }
+}
+BENCHMARK(BM_serveCached);
+
+// Like BM_serveCached, with the theme of one page switched every range(0)
+// requests: to the theme of another page, or to a brand new theme when
+// range(1) is 1, which leaves the cache with pages in themes that are gone.
+static void BM_serveSwitchingThemes(bench::State& state)
+{
+  std::vector<std::shared_ptr<WebPage>> pages = makeSite();
+  std::vector<std::size_t> requests = makeRequests(pages.size());
+  const std::int64_t switchEvery = state.range(0);
+  RenderCache cache;
+  std::size_t next = 0;
+  std::int64_t untilSwitch = switchEvery;
+  while (state.keepRunning()) {
+    WebPage& page = *pages[requests[next]];
+    if (--untilSwitch == 0) {
+      if (state.range(1)) {
+        page.setTheme(std::make_shared<AquaTheme>());
+      } else {
+        page.setTheme(pages[(requests[next] + 3) % pages.size()]->getTheme());
+      }
+      untilSwitch = switchEvery;
+    }
+    RenderCache::content_t content = cache.getContent(page);
+    bench::doNotOptimize(content);
+    next = (next + 1) % requests.size();
+  }
+  state.counters["cached_pages"] = static_cast<double>(cache.getSize());
+}
+BENCHMARK(BM_serveSwitchingThemes)
+    ->Args({10, 0})->Args({1000, 0})->Args({10, 1});
+
+static const std::size_t kRequestsPerThread = 100000;
+
+// range(0) threads serving requests from one cache at once.
+static void BM_serveCachedConcurrent(bench::State& state)
+{
+  const std::size_t threads = static_cast<std::size_t>(state.range(0));
+  std::vector<std::shared_ptr<WebPage>> pages = makeSite();
+  std::vector<std::size_t> requests = makeRequests(pages.size());
+  RenderCache cache;
+  while (state.keepRunning()) {
+    std::vector<std::thread> servers;
+    for (std::size_t t = 0; t < threads; ++t) {
+      servers.emplace_back([&pages, &requests, &cache, t]() {
+        std::size_t next = t * 7 % requests.size();
+        for (std::size_t i = 0; i < kRequestsPerThread; ++i) {
+          bench::doNotOptimize(cache.getContent(*pages[requests[next]]));
+          next = (next + 1) % requests.size();
+        }
+      });
+    }
+    for (auto& server : servers) {
+      server.join();
+    }
+  }
+  state.setItemsProcessed(state.iterations() * threads * kRequestsPerThread);
+}
+BENCHMARK(BM_serveCachedConcurrent)->Arg(1)->Arg(4)->Arg(16);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,172 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/structural/composite.cpp"
+#undef main
+
+static void BM_getNetSalaries(bench::State& state)
+{
+  Organization org;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    if (i % 2) {
+      org.addEmployee(std::make_shared<Developer>("Jane", 50000));
+    } else {
+      org.addEmployee(std::make_shared<Designer>("John", 45000));
+    }
+  }
+
+  while (state.keepRunning()) {
+    bench::doNotOptimize(org.getNetSalaries());
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_getNetSalaries)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static void fillColumnar(ColumnarOrganization& org, std::int64_t employees)
+{
+  std::shared_ptr<Employee> jane = std::make_shared<Developer>("Jane", 50000);
+  std::shared_ptr<Employee> john = std::make_shared<Designer>("John", 45000);
+  for (std::int64_t i = 0; i < employees; ++i) {
+    org.addEmployee(i % 2 ? jane : john);
+  }
+}
+
+static void BM_getNetSalariesColumnar(bench::State& state)
+{
+  ColumnarOrganization org;
+  fillColumnar(org, state.range(0));
+
+  while (state.keepRunning()) {
+    bench::doNotOptimize(org.getNetSalaries());
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_getNetSalariesColumnar)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static void BM_getNetSalariesColumnarRole(bench::State& state)
+{
+  ColumnarOrganization org;
+  fillColumnar(org, state.range(0));
+  const std::string role = "Developer";
+
+  while (state.keepRunning()) {
+    bench::doNotOptimize(org.getNetSalaries(role));
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_getNetSalariesColumnarRole)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static void BM_getNetSalariesByRole(bench::State& state)
+{
+  ColumnarOrganization org;
+  fillColumnar(org, state.range(0));
+
+  while (state.keepRunning()) {
+    std::map<std::string, float> byRole = org.getNetSalariesByRole();
+    bench::doNotOptimize(byRole);
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_getNetSalariesByRole)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+// Scaling of the deterministic parallel sum: range(0) employees, each a
+// separate object with its own salary, summed on range(1) threads. The 100M
+// employee runs use the columnar organization below, as 100M separate
+// objects take more than 10 GB.
+static void BM_getNetSalariesParallel(bench::State& state)
+{
+  Organization org;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    float salary = 40000 + i % 20000 + 0.5f * (i % 2);
+    if (i % 2) {
+      org.addEmployee(std::make_shared<Developer>("Jane", salary));
+    } else {
+      org.addEmployee(std::make_shared<Designer>("John", salary));
+    }
+  }
+
+  double net = 0;
+  while (state.keepRunning()) {
+    net = org.getNetSalariesParallel(static_cast<unsigned>(state.range(1)));
+    bench::doNotOptimize(net);
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+  state.counters["net_salaries"] = net;
+}
+BENCHMARK(BM_getNetSalariesParallel)
+    ->Args({10000000, 1})->Args({10000000, 2})->Args({10000000, 4})
+    ->Args({10000000, 8})->Args({10000000, 16})->Args({10000000, 32});
+
+static void BM_getNetSalariesColumnarParallel(bench::State& state)
+{
+  ColumnarOrganization org;
+  std::shared_ptr<Employee> jane = std::make_shared<Developer>("Jane", 50000);
+  std::shared_ptr<Employee> john = std::make_shared<Designer>("John", 45000);
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    std::shared_ptr<Employee> employee = i % 2 ? jane : john;
+    employee->setSalary(40000 + i % 20000 + 0.5f * (i % 2));
+    org.addEmployee(employee);
+  }
+
+  double net = 0;
+  while (state.keepRunning()) {
+    net = org.getNetSalariesParallel(static_cast<unsigned>(state.range(1)));
+    bench::doNotOptimize(net);
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+  state.counters["net_salaries"] = net;
+}
+BENCHMARK(BM_getNetSalariesColumnarParallel)
+    ->Args({100000000, 1})->Args({100000000, 2})->Args({100000000, 4})
+    ->Args({100000000, 8})->Args({100000000, 16})->Args({100000000, 32});
+
+// A tree of 10 departments with 100 teams of 1000 employees each.
+static std::shared_ptr<Department> makeTree(
+    std::vector<std::shared_ptr<Employee>>& employees)
+{
+  std::shared_ptr<Department> root = std::make_shared<Department>("Company");
+  for (int d = 0; d < 10; ++d) {
+    std::shared_ptr<Department> department =
+        std::make_shared<Department>("Department");
+    root->addDepartment(department);
+    for (int t = 0; t < 100; ++t) {
+      std::shared_ptr<Department> team = std::make_shared<Department>("Team");
+      department->addDepartment(team);
+      for (int e = 0; e < 1000; ++e) {
+        employees.push_back(
+            team->addEmployee(std::make_unique<Developer>("Jane", 50000)));
+      }
+    }
+  }
+
+  return root;
+}
+
+// Each tick changes the salary of 1% of the employees and then asks for the
+// net salaries of the whole company, either from the cached subtotals
+// (range(0) == 1) or by walking the tree again (range(0) == 0).
+static void BM_hierarchyTick(bench::State& state)
+{
+  std::vector<std::shared_ptr<Employee>> employees;
+  std::shared_ptr<Department> root = makeTree(employees);
+  const std::size_t updates = employees.size() / 100;
+  const bool cached = state.range(0) != 0;
+
+  bench::Random random;
+  float salary = 50000;
+  while (state.keepRunning()) {
+    for (std::size_t i = 0; i < updates; ++i) {
+      std::uint64_t seed = random.next();
+      employees[(seed >> 33) % employees.size()]->setSalary(salary);
+      salary = salary == 50000 ? 51000 : 50000;
+    }
+    if (cached) {
+      bench::doNotOptimize(root->getNetSalaries());
+    } else {
+      bench::doNotOptimize(root->recomputeNetSalaries());
+    }
+  }
+}
+BENCHMARK(BM_hierarchyTick)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
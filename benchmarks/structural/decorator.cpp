@@ -0,0 +1,129 @@
+#include "../bench.h"
+
+#include <tuple>
+#include <utility>
+
+#define main example_main
+#include "../../examples/structural/decorator.cpp"
+#undef main
+
+// Builds a stack of `depth` decorators around a simple coffee, cycling through
+// the available condiments.
+static std::shared_ptr<Coffee> makeStack(std::int64_t depth)
+{
+  std::shared_ptr<Coffee> coffee = std::make_shared<SimpleCoffee>();
+  for (std::int64_t i = 0; i < depth; ++i) {
+    switch (i % 3) {
+      case 0: coffee = std::make_shared<MilkCoffee>(coffee); break;
+      case 1: coffee = std::make_shared<WhipCoffee>(coffee); break;
+      default: coffee = std::make_shared<VanillaCoffee>(coffee); break;
+    }
+  }
+  return coffee;
+}
+
+static void BM_getPrice(bench::State& state)
+{
+  std::shared_ptr<Coffee> coffee = makeStack(state.range(0));
+  while (state.keepRunning()) {
+    bench::doNotOptimize(coffee->getPrice());
+  }
+}
+BENCHMARK(BM_getPrice)->Range(1, 64, 2);
+
+static void BM_getDescription(bench::State& state)
+{
+  std::shared_ptr<Coffee> coffee = makeStack(state.range(0));
+  while (state.keepRunning()) {
+    std::string description = coffee->getDescription();
+    bench::doNotOptimize(description);
+  }
+}
+BENCHMARK(BM_getDescription)->Range(1, 64, 2)->Arg(50);
+
+// Renders into a buffer owned by the caller, which only allocates the first
+// time it grows.
+static void BM_appendDescription(bench::State& state)
+{
+  std::shared_ptr<Coffee> coffee = makeStack(state.range(0));
+  std::string description;
+  while (state.keepRunning()) {
+    description.clear();
+    coffee->appendDescription(description);
+    bench::doNotOptimize(description);
+  }
+}
+BENCHMARK(BM_appendDescription)->Range(1, 64, 2)->Arg(50);
+
+// A stack of range(0) versioned condiments over a house coffee whose price
+// changes once every range(1) queries. Each query asks for the price and the
+// description of the top of the stack. range(2) == 0 queries the plain
+// runtime decorators instead, which cannot cache.
+static void BM_queryVersioned(bench::State& state)
+{
+  const std::int64_t depth = state.range(0);
+  const std::int64_t queriesPerUpdate = state.range(1);
+  std::shared_ptr<HouseCoffee> house = std::make_shared<HouseCoffee>(3);
+  std::shared_ptr<VersionedCoffee> versioned = house;
+  static const char* names[] = {"milk", "whip", "vanilla"};
+  static const float prices[] = {0.5, 2, 1};
+  for (std::int64_t i = 0; i < depth; ++i) {
+    versioned = std::make_shared<VersionedCondiment>(versioned, names[i % 3],
+                                                     prices[i % 3]);
+  }
+  // A second product sharing everything but the top condiment.
+  std::shared_ptr<VersionedCoffee> sibling =
+      std::make_shared<VersionedCondiment>(versioned, "milk", 0.5);
+  std::shared_ptr<Coffee> plain = makeStack(depth);
+  Coffee& coffee = state.range(2) ? static_cast<Coffee&>(*sibling) : *plain;
+
+  std::string description;
+  std::int64_t query = 0;
+  std::int64_t updates = 0;
+  while (state.keepRunning()) {
+    if (++query == queriesPerUpdate) {
+      house->setPrice(++updates % 2 ? 3.5 : 3);
+      query = 0;
+    }
+    description.clear();
+    coffee.appendDescription(description);
+    bench::doNotOptimize(coffee.getPrice());
+    bench::doNotOptimize(description);
+  }
+}
+BENCHMARK(BM_queryVersioned)
+    ->Args({64, 10, 0})->Args({64, 10, 1})
+    ->Args({64, 1000, 0})->Args({64, 1000, 1})
+    ->Args({64, 100000, 0})->Args({64, 100000, 1});
+
+// Decorated<SimpleCoffee, ...> with `Depth` condiments, cycling through them
+// in the same order as makeStack().
+template <std::size_t Index>
+using CondimentAt =
+    typename std::tuple_element<Index % 3,
+                                std::tuple<Milk, Whip, Vanilla>>::type;
+
+template <std::size_t... Indices>
+Decorated<SimpleCoffee, CondimentAt<Indices>...> decorate(
+    std::index_sequence<Indices...>);
+
+template <std::size_t Depth>
+using DecoratedStack = decltype(decorate(std::make_index_sequence<Depth>()));
+
+template <std::size_t Depth>
+static void BM_getPriceStatic(bench::State& state)
+{
+  DecoratedStack<Depth> coffee;
+  while (state.keepRunning()) {
+    bench::doNotOptimize(coffee.getPrice());
+  }
+}
+BENCHMARK(BM_getPriceStatic<1>);
+BENCHMARK(BM_getPriceStatic<2>);
+BENCHMARK(BM_getPriceStatic<4>);
+BENCHMARK(BM_getPriceStatic<8>);
+BENCHMARK(BM_getPriceStatic<16>);
+BENCHMARK(BM_getPriceStatic<32>);
+BENCHMARK(BM_getPriceStatic<64>);
+
+BENCHMARK_MAIN()
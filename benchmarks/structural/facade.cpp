@@ -0,0 +1,17 @@
+#include "../bench.h"
+
+#define main example_main
+#include "../../examples/structural/facade.cpp"
+#undef main
+
+static void BM_turnOnOff(bench::State& state)
+{
+  ComputerFacade facade(std::make_shared<Computer>());
+  while (state.keepRunning()) {
+    facade.turnOn();
+    facade.turnOff();
+  }
+}
+BENCHMARK(BM_turnOnOff);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,290 @@
+#include "../bench.h"
+
+#include <malloc.h>
+
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define main example_main
+#include "../../examples/structural/flyweight.cpp"
+#undef main
+
+static const std::size_t kWarmPreferences = 1024;
+static const std::size_t kRequests = 1 << 16;
+
+// Calls TeaMaker::make where range(0) percent of the requests hit a
+// preference that is already available and the rest are brand new.
+static void BM_make(bench::State& state)
+{
+  std::vector<std::string> warm;
+  for (std::size_t i = 0; i < kWarmPreferences; ++i) {
+    warm.push_back("preference " + std::to_string(i));
+  }
+  std::vector<std::string> requests;
+  for (std::size_t i = 0; i < kRequests; ++i) {
+    if (static_cast<std::int64_t>(i % 100) < state.range(0)) {
+      requests.push_back(warm[(i * 7919) % kWarmPreferences]);
+    } else {
+      requests.push_back("new preference " + std::to_string(i));
+    }
+  }
+
+  std::shared_ptr<TeaMaker> maker;
+  std::size_t next = requests.size();
+  std::int64_t hits = 0;
+  while (state.keepRunning()) {
+    if (next == requests.size()) {
+      // Start over with a fresh maker so that misses keep missing.
+      state.pauseTiming();
+      maker = std::make_shared<TeaMaker>();
+      for (std::size_t i = 0; i < warm.size(); ++i) {
+        maker->make(warm[i]);
+      }
+      next = 0;
+      state.resumeTiming();
+    }
+    int before = maker->getPreferenceCount();
+    bench::doNotOptimize(maker->make(requests[next++]));
+    hits += maker->getPreferenceCount() == before;
+  }
+  state.counters["hit_rate"] =
+      static_cast<double>(hits) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_make)->Arg(0)->Arg(50)->Arg(90)->Arg(100);
+
+static void BM_takeOrder(bench::State& state)
+{
+  std::vector<std::string> preferences;
+  for (int i = 0; i < 16; ++i) {
+    preferences.push_back("preference " + std::to_string(i));
+  }
+  TeaShop shop(std::make_shared<TeaMaker>());
+  std::int64_t order = 0;
+  while (state.keepRunning()) {
+    shop.takeOrder(preferences[order % preferences.size()],
+                   static_cast<int>(order % state.range(0)));
+    ++order;
+  }
+}
+BENCHMARK(BM_takeOrder)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static void BM_serve(bench::State& state)
+{
+  TeaShop shop(std::make_shared<TeaMaker>());
+  for (std::int64_t table = 0; table < state.range(0); ++table) {
+    shop.takeOrder("half sugar", static_cast<int>(table));
+  }
+  while (state.keepRunning()) {
+    shop.serve();
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_serve)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+// The same two benchmarks for the table indexed shop.
+static void BM_takeOrderDense(bench::State& state)
+{
+  std::vector<std::string> preferences;
+  for (int i = 0; i < 16; ++i) {
+    preferences.push_back("preference " + std::to_string(i));
+  }
+  DenseTeaShop shop(std::make_shared<TeaMaker>());
+  std::int64_t order = 0;
+  while (state.keepRunning()) {
+    shop.takeOrder(preferences[order % preferences.size()],
+                   static_cast<int>(order % state.range(0)));
+    ++order;
+  }
+}
+BENCHMARK(BM_takeOrderDense)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static void BM_serveDense(bench::State& state)
+{
+  DenseTeaShop shop(std::make_shared<TeaMaker>());
+  for (std::int64_t table = 0; table < state.range(0); ++table) {
+    shop.takeOrder("half sugar", static_cast<int>(table));
+  }
+  while (state.keepRunning()) {
+    shop.serve();
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_serveDense)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+static std::vector<std::string> orderPreferences(void)
+{
+  std::vector<std::string> preferences;
+  for (int i = 0; i < 64; ++i) {
+    preferences.push_back("a cup of tea with preference " + std::to_string(i));
+  }
+  return preferences;
+}
+
+static void BM_takeOrderInterned(bench::State& state)
+{
+  std::vector<std::string> preferences = orderPreferences();
+  InternedTeaShop shop(std::make_shared<InternedTeaMaker>());
+  std::int64_t order = 0;
+  while (state.keepRunning()) {
+    shop.takeOrder(preferences[order % preferences.size()],
+                   static_cast<int>(order % state.range(0)));
+    ++order;
+  }
+}
+BENCHMARK(BM_takeOrderInterned)->Arg(1000)->Arg(100000);
+
+// Takes range(0) orders for distinct tables and reports how much the
+// resident set grew while the orders were held. range(1) selects the
+// original TeaShop (0) or the InternedTeaShop (1).
+static void BM_ordersResident(bench::State& state)
+{
+  std::vector<std::string> preferences = orderPreferences();
+  const std::int64_t orders = state.range(0);
+  std::size_t growth = 0;
+  bool first = true;
+  while (state.keepRunning()) {
+    // Hand memory freed by earlier runs back to the system first, otherwise
+    // it would be reused without growing the resident set.
+    state.pauseTiming();
+    malloc_trim(0);
+    std::size_t before = bench::residentBytes();
+    state.resumeTiming();
+    if (state.range(1)) {
+      InternedTeaShop shop(std::make_shared<InternedTeaMaker>());
+      for (std::int64_t i = 0; i < orders; ++i) {
+        shop.takeOrder(preferences[i % preferences.size()],
+                       static_cast<int>(i));
+      }
+      growth = first ? bench::residentBytes() - before : growth;
+      state.pauseTiming();
+    } else {
+      TeaShop shop(std::make_shared<TeaMaker>());
+      for (std::int64_t i = 0; i < orders; ++i) {
+        shop.takeOrder(preferences[i % preferences.size()],
+                       static_cast<int>(i));
+      }
+      growth = first ? bench::residentBytes() - before : growth;
+      state.pauseTiming();
+    }
+    first = false;
+    state.resumeTiming();
+  }
+  state.setItemsProcessed(state.iterations() * orders);
+  state.counters["rss_growth_bytes"] = static_cast<double>(growth);
+}
+BENCHMARK(BM_ordersResident)->Args({10000000, 0})->Args({10000000, 1});
+
+static const std::size_t kContendedPreferences = 4096;
+static const std::size_t kLookupsPerThread = 100000;
+
+// Runs kLookupsPerThread lookups on each of `threads` threads, all drawing
+// from the same set of mostly existing preferences.
+template <typename Make>
+static void runContended(const std::vector<std::string>& preferences,
+                         std::int64_t threads, Make make)
+{
+  std::vector<std::thread> workers;
+  for (std::int64_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&preferences, &make, t]() {
+      std::size_t next = static_cast<std::size_t>(t) * 7919;
+      for (std::size_t i = 0; i < kLookupsPerThread; ++i) {
+        next = (next + 40503) % preferences.size();
+        bench::doNotOptimize(make(preferences[next]));
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+static std::vector<std::string> contendedPreferences(void)
+{
+  std::vector<std::string> preferences;
+  for (std::size_t i = 0; i < kContendedPreferences; ++i) {
+    preferences.push_back("preference " + std::to_string(i));
+  }
+  return preferences;
+}
+
+// The original TeaMaker behind a single mutex, since it is not thread-safe.
+static void BM_makeContendedMutex(bench::State& state)
+{
+  std::vector<std::string> preferences = contendedPreferences();
+  TeaMaker maker;
+  std::mutex mutex;
+  while (state.keepRunning()) {
+    runContended(preferences, state.range(0),
+        [&maker, &mutex](const std::string& preference) {
+          std::lock_guard<std::mutex> lock(mutex);
+          return maker.make(preference);
+        });
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0) *
+                          kLookupsPerThread);
+}
+BENCHMARK(BM_makeContendedMutex)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+static void BM_makeContendedSharded(bench::State& state)
+{
+  std::vector<std::string> preferences = contendedPreferences();
+  ConcurrentTeaMaker maker;
+  while (state.keepRunning()) {
+    runContended(preferences, state.range(0),
+        [&maker](const std::string& preference) {
+          return maker.make(preference);
+        });
+  }
+  state.setItemsProcessed(state.iterations() * state.range(0) *
+                          kLookupsPerThread);
+}
+BENCHMARK(BM_makeContendedSharded)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+static const std::size_t kSkewedPreferences = 100000;
+static const std::size_t kSkewedRequests = 1 << 20;
+static const std::size_t kOpenOrders = 4096;
+
+// Requests for kSkewedPreferences preferences where a few are very popular.
+static std::vector<std::string> skewedRequests(void)
+{
+  std::vector<std::string> requests;
+  bench::Random random;
+  for (std::size_t i = 0; i < kSkewedRequests; ++i) {
+    std::uint64_t seed = random.next();
+    double uniform = static_cast<double>(seed >> 11) / 9007199254740992.0;
+    std::size_t rank = static_cast<std::size_t>(
+        std::pow(uniform, 4) * kSkewedPreferences);
+    requests.push_back("preference " + std::to_string(rank));
+  }
+  return requests;
+}
+
+// BoundedTeaMaker with policy range(0) and capacity range(1). The last
+// kOpenOrders teas are kept alive as if their orders were not served yet.
+static void BM_makeBounded(bench::State& state)
+{
+  std::vector<std::string> requests = skewedRequests();
+  BoundedTeaMaker maker(static_cast<std::size_t>(state.range(1)),
+                        static_cast<EvictionPolicy>(state.range(0)));
+  std::vector<std::shared_ptr<Tea>> orders(kOpenOrders);
+  std::size_t next = 0;
+  while (state.keepRunning()) {
+    orders[next % kOpenOrders] = maker.make(requests[next % requests.size()]);
+    ++next;
+  }
+
+  TeaMakerStats stats = maker.getStats();
+  state.counters["hit_rate"] = static_cast<double>(stats.hits) /
+      static_cast<double>(stats.hits + stats.misses);
+  state.counters["evictions"] = static_cast<double>(stats.evictions);
+  state.counters["resident_bytes"] = static_cast<double>(stats.residentBytes);
+}
+BENCHMARK(BM_makeBounded)
+    ->Args({0, 1000})->Args({0, 10000})
+    ->Args({1, 1000})->Args({1, 10000})
+    ->Args({2, 1000})->Args({2, 10000});
+
+BENCHMARK_MAIN()
@@ -0,0 +1,206 @@
+#include "../bench.h"
+
+#include <thread>
+#include <vector>
+
+#define main example_main
+#include "../../examples/structural/proxy.cpp"
+#undef main
+
+// The password limit is set high enough to never get in the way.
+static void BM_openAccepted(bench::State& state)
+{
+  SecuredDoor securedDoor(std::make_shared<LabDoor>(), 1e9, 1e9);
+  const std::string password = "Bond007";
+  while (state.keepRunning()) {
+    securedDoor.open(password);
+  }
+}
+BENCHMARK(BM_openAccepted);
+
+static void BM_openRejected(bench::State& state)
+{
+  SecuredDoor securedDoor(std::make_shared<LabDoor>(), 1e9, 1e9);
+  const std::string password = "invalid";
+  while (state.keepRunning()) {
+    securedDoor.open(password);
+  }
+}
+BENCHMARK(BM_openRejected);
+
+// Opens the door with a session token, with a limit high enough to never
+// get in the way.
+static void BM_openSession(bench::State& state)
+{
+  SecuredDoor securedDoor(std::make_shared<LabDoor>(), 1e9, 1e9);
+  std::uint64_t token = securedDoor.login("Bond", "Bond007");
+  while (state.keepRunning()) {
+    bench::doNotOptimize(securedDoor.open(token));
+  }
+}
+BENCHMARK(BM_openSession);
+
+static void BM_openUnknownSession(bench::State& state)
+{
+  SecuredDoor securedDoor(std::make_shared<LabDoor>());
+  std::uint64_t token = securedDoor.login("Bond", "Bond007");
+  while (state.keepRunning()) {
+    bench::doNotOptimize(securedDoor.open(token + 1));
+  }
+}
+BENCHMARK(BM_openUnknownSession);
+
+// A caller far over its limit, so that every call is turned away.
+static void BM_openRateLimited(bench::State& state)
+{
+  SecuredDoor securedDoor(std::make_shared<LabDoor>(), 1, 1);
+  std::uint64_t token = securedDoor.login("Bond", "Bond007");
+  securedDoor.open(token);
+  while (state.keepRunning()) {
+    bench::doNotOptimize(securedDoor.open(token));
+  }
+}
+BENCHMARK(BM_openRateLimited);
+
+static const std::size_t kOpensPerThread = 100000;
+
+// range(0) threads, one session each, opening the same door at once; half of
+// them are over their limit when range(1) is 1.
+static void BM_openSessionConcurrent(bench::State& state)
+{
+  const std::size_t threads = static_cast<std::size_t>(state.range(0));
+  SecuredDoor securedDoor(std::make_shared<LabDoor>(), 1e9, 1e9);
+  SecuredDoor limitedDoor(std::make_shared<LabDoor>(), 1, 1);
+  std::vector<std::uint64_t> tokens;
+  for (std::size_t t = 0; t < threads; ++t) {
+    SecuredDoor& door = state.range(1) && t % 2 ? limitedDoor : securedDoor;
+    tokens.push_back(door.login("Bond" + std::to_string(t), "Bond007"));
+  }
+
+  while (state.keepRunning()) {
+    std::vector<std::thread> openers;
+    for (std::size_t t = 0; t < threads; ++t) {
+      SecuredDoor& door = state.range(1) && t % 2 ? limitedDoor : securedDoor;
+      std::uint64_t token = tokens[t];
+      openers.emplace_back([&door, token]() {
+        for (std::size_t i = 0; i < kOpensPerThread; ++i) {
+          bench::doNotOptimize(door.open(token));
+        }
+      });
+    }
+    for (auto& opener : openers) {
+      opener.join();
+    }
+  }
+  state.setItemsProcessed(state.iterations() * threads * kOpensPerThread);
+}
+BENCHMARK(BM_openSessionConcurrent)
+    ->Args({1, 0})->Args({4, 0})->Args({16, 0})->Args({16, 1});
+
+// A door that takes a while to set up, e.g. to load its keys from disk.
+class SlowDoor : public LabDoor
+{
+  public:
+    static constexpr std::chrono::microseconds kSetupTime{100};
+
+    SlowDoor(void)
+    {
+      std::this_thread::sleep_for(kSetupTime);
+    }
+};
+
+// Starts up range(0) doors, each built up front.
+static void BM_startupEager(bench::State& state)
+{
+  const std::size_t count = static_cast<std::size_t>(state.range(0));
+  while (state.keepRunning()) {
+    std::vector<std::shared_ptr<Door>> doors;
+    for (std::size_t i = 0; i < count; ++i) {
+      doors.push_back(std::make_shared<SlowDoor>());
+    }
+    state.pauseTiming();
+    doors.clear();
+    state.resumeTiming();
+  }
+  state.setItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_startupEager)->Arg(100)->Arg(500);
+
+// The same doors behind lazy proxies, none of which is ever opened.
+static void BM_startupLazy(bench::State& state)
+{
+  const std::size_t count = static_cast<std::size_t>(state.range(0));
+  while (state.keepRunning()) {
+    std::vector<std::shared_ptr<Door>> doors;
+    for (std::size_t i = 0; i < count; ++i) {
+      doors.push_back(std::make_shared<LazyDoor>(
+          []() { return std::make_shared<SlowDoor>(); }));
+    }
+    state.pauseTiming();
+    doors.clear();
+    state.resumeTiming();
+  }
+  state.setItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_startupLazy)->Arg(100)->Arg(500);
+
+// The first opening of a lazy door, warmed up in the background beforehand
+// when range(0) is 1.
+static void BM_firstOpenLazy(bench::State& state)
+{
+  while (state.keepRunning()) {
+    state.pauseTiming();
+    LazyDoor door([]() { return std::make_shared<SlowDoor>(); });
+    if (state.range(0)) {
+      door.warmUp();
+      std::this_thread::sleep_for(2 * SlowDoor::kSetupTime);
+    }
+    state.resumeTiming();
+    door.open();
+    state.pauseTiming();
+  }
+}
+BENCHMARK(BM_firstOpenLazy)->Arg(0)->Arg(1);
+
+// range(0) threads opening a lazy door that nobody has opened before. The
+// door must be built once, and everybody waits for it.
+static void BM_firstOpenConcurrent(bench::State& state)
+{
+  const std::size_t threads = static_cast<std::size_t>(state.range(0));
+  std::atomic<std::int64_t> builds(0);
+  LazyDoor::factory_t buildSlowDoor = [&builds]() {
+    ++builds;
+    return std::make_shared<SlowDoor>();
+  };
+  while (state.keepRunning()) {
+    LazyDoor door(buildSlowDoor);
+    std::vector<std::thread> openers;
+    for (std::size_t t = 0; t < threads; ++t) {
+      openers.emplace_back([&door]() { door.open(); });
+    }
+    for (auto& opener : openers) {
+      opener.join();
+    }
+  }
+  state.counters["builds_per_door"] =
+      static_cast<double>(builds) / state.iterations();
+}
+BENCHMARK(BM_firstOpenConcurrent)->Arg(1)->Arg(16);
+
+// Opening a door that has already been built, directly and through a lazy
+// proxy.
+static void BM_openBuilt(bench::State& state)
+{
+  std::shared_ptr<Door> labDoor = std::make_shared<LabDoor>();
+  std::shared_ptr<Door> door = labDoor;
+  if (state.range(0)) {
+    door = std::make_shared<LazyDoor>([labDoor]() { return labDoor; });
+    door->open();
+  }
+  while (state.keepRunning()) {
+    door->open();
+  }
+}
+BENCHMARK(BM_openBuilt)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN()
@@ -1,6 +1,29 @@
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "../log.h"
+
+class Account;
+
+// The part of a payment taken from one account.
+struct Charge
+{
+  std::size_t payment;
+  Account* account;
+  std::int64_t cents;
+};
 
 class Account
 {
@@ -15,29 +38,202 @@ class Account
       successor_ = account;
     }
 
+    std::shared_ptr<Account> getNext(void) const
+    {
+      return successor_;
+    }
+
+    // Walks the chain iteratively, so that long chains do not use up the
+    // stack. Any number of threads can pay through the same chain.
     void pay(float amount)
     {
-      if (canPay(amount)) {
-        std::cout << "Paid " << amount << " using " << name_ << "."
-                  << std::endl;
-        balance_ -= amount;
-      } else if (successor_) {
-        std::cout << "Cannot pay using " << name_ << ". Proceeding ..."
-                  << std::endl;
-        successor_->pay(amount);
-      } else {
-        std::cerr << "None of the accounts have enough balance." << std::endl;
+      std::int64_t cents = toCents(amount);
+      Account* account = this;
+      while (!account->tryWithdraw(cents)) {
+        if (!account->successor_) {
+          std::cerr << "None of the accounts have enough balance."
+                    << std::endl;
+          return;
+        }
+        LOG("Cannot pay using ", account->name_, ". Proceeding ...");
+        account = account->successor_.get();
+      }
+      LOG("Paid ", amount, " using ", account->name_, ".");
+    }
+
+    // The same without a word: returns the account that paid, or nullptr if
+    // none could.
+    Account* tryPay(float amount)
+    {
+      std::int64_t cents = toCents(amount);
+      for (Account* account = this; account;
+           account = account->successor_.get()) {
+        if (account->tryWithdraw(cents)) {
+          return account;
+        }
+      }
+      return nullptr;
+    }
+
+    // Settles a batch of payments in one pass along the chain. Unlike pay(),
+    // a payment may be split over several accounts: it is taken from the
+    // first accounts that still have money, in chain order. A payment the
+    // chain can not cover in full is not made at all. The parts of the
+    // payments made are appended to `charges`; returns how many were made.
+    // Payments made concurrently with the batch are taken into account, but
+    // money given back by a concurrent batch may be missed. Throws, and pays
+    // nothing, if a payment is not at least a cent.
+    std::size_t settle(const std::vector<float>& amounts,
+                       std::vector<Charge>& charges)
+    {
+      for (float amount : amounts) {
+        if (toCents(amount) <= 0) {
+          throw std::invalid_argument("Payments must be positive.");
+        }
+      }
+
+      // Balances only go down while others pay, so this bounds what can
+      // still be taken from the cursor on.
+      std::int64_t available = 0;
+      for (Account* account = this; account;
+           account = account->successor_.get()) {
+        available += std::max<std::int64_t>(account->getCents(), 0);
       }
+
+      // Every account before the cursor is empty.
+      Account* cursor = this;
+      std::size_t settled = 0;
+      std::size_t payment = 0;
+      while (payment < amounts.size()) {
+        // Take every following payment the cursor covers in one go.
+        std::int64_t balance = cursor->getCents();
+        std::int64_t sum = 0;
+        std::size_t end = payment;
+        for (; end < amounts.size(); ++end) {
+          std::int64_t cents = toCents(amounts[end]);
+          if (sum + cents > balance) {
+            break;
+          }
+          sum += cents;
+        }
+        if (end > payment) {
+          if (!cursor->balance_.compare_exchange_weak(
+                  balance, balance - sum, std::memory_order_acq_rel,
+                  std::memory_order_relaxed)) {
+            continue;
+          }
+          settled += end - payment;
+          for (; payment < end; ++payment) {
+            charges.push_back(
+                Charge{payment, cursor, toCents(amounts[payment])});
+          }
+          available -= sum;
+          continue;
+        }
+
+        // The next payment is more than the cursor holds: split it over the
+        // following accounts.
+        std::int64_t cents = toCents(amounts[payment++]);
+        if (cents > available) {
+          continue;
+        }
+
+        std::size_t firstCharge = charges.size();
+        std::int64_t remaining = cents;
+        Account* account = cursor;
+        while (account) {
+          std::int64_t taken = account->withdrawUpTo(remaining);
+          if (taken > 0) {
+            charges.push_back(Charge{payment - 1, account, taken});
+            remaining -= taken;
+          }
+          if (remaining == 0) {
+            break;
+          }
+          account = account->successor_.get();
+        }
+
+        if (remaining > 0) {
+          // Others paid in the meantime; give the parts back.
+          for (std::size_t i = firstCharge; i < charges.size(); ++i) {
+            charges[i].account->deposit(charges[i].cents);
+          }
+          charges.resize(firstCharge);
+          available = std::min(available, cents - 1);
+          continue;
+        }
+        available -= cents;
+        cursor = account;
+        ++settled;
+      }
+      return settled;
     }
 
     bool canPay(float amount)
     {
-      return balance_ >= amount;
+      return getCents() >= toCents(amount);
+    }
+
+    // Takes `cents` off the balance unless that would overdraw it. Checking
+    // and taking happen in one compare-and-swap, so concurrent payers can
+    // never overdraw the account together.
+    bool tryWithdraw(std::int64_t cents)
+    {
+      std::int64_t balance = balance_.load(std::memory_order_relaxed);
+      while (balance >= cents) {
+        if (balance_.compare_exchange_weak(balance, balance - cents,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_relaxed)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Takes up to `cents` off the balance and returns how much it took.
+    std::int64_t withdrawUpTo(std::int64_t cents)
+    {
+      std::int64_t balance = balance_.load(std::memory_order_relaxed);
+      while (balance > 0) {
+        std::int64_t taken = std::min(balance, cents);
+        if (balance_.compare_exchange_weak(balance, balance - taken,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_relaxed)) {
+          return taken;
+        }
+      }
+      return 0;
+    }
+
+    void deposit(std::int64_t cents)
+    {
+      balance_.fetch_add(cents, std::memory_order_acq_rel);
+    }
+
+    float getBalance(void) const
+    {
+      return static_cast<float>(getCents() / 100.0);
+    }
+
+    std::int64_t getCents(void) const
+    {
+      return balance_.load(std::memory_order_acquire);
+    }
+
+    static std::int64_t toCents(float amount)
+    {
+      return std::llround(static_cast<double>(amount) * 100.0);
+    }
+
+    const std::string& getName(void) const
+    {
+      return name_;
     }
 
   protected:
     std::string name_;
-    float balance_;
+    // In cents, so that balances add up exactly.
+    std::atomic<std::int64_t> balance_;
     std::shared_ptr<Account> successor_;
 };
 
@@ -47,7 +243,7 @@ class Bank : public Account
     Bank(float balance)
     {
       name_ = "bank";
-      balance_ = balance;
+      balance_ = toCents(balance);
     }
 };
 
@@ -57,7 +253,7 @@ class Paypal : public Account
     Paypal(float balance)
     {
       name_ = "paypal";
-      balance_ = balance;
+      balance_ = toCents(balance);
     }
 };
 
@@ -67,10 +263,169 @@ class Bitcoin : public Account
     Bitcoin(float balance)
     {
       name_ = "bitcoin";
-      balance_ = balance;
+      balance_ = toCents(balance);
     }
 };
 
+// A chain whose shape is known at compile time, e.g. Chain<Bank, Paypal,
+// Bitcoin>. The accounts live inside the chain, which is built from their
+// balances in order, and a payment is a fixed sequence of inlined checks
+// rather than a walk through pointers.
+template <typename... Accounts>
+class Chain
+{
+  public:
+    template <typename... Balances>
+    explicit Chain(Balances... balances)
+        : accounts_(balances...)
+    {
+      static_assert(sizeof...(Balances) == sizeof...(Accounts),
+                    "Every account needs a balance.");
+    }
+
+    void pay(float amount)
+    {
+      if (!pay(amount, Account::toCents(amount), indices_t())) {
+        std::cerr << "None of the accounts have enough balance." << std::endl;
+      }
+    }
+
+    Account* tryPay(float amount)
+    {
+      return tryPay(Account::toCents(amount), indices_t());
+    }
+
+    template <std::size_t Index>
+    Account& getAccount(void)
+    {
+      return std::get<Index>(accounts_);
+    }
+
+  private:
+    typedef std::index_sequence_for<Accounts...> indices_t;
+
+    template <std::size_t... Indices>
+    bool pay(float amount, std::int64_t cents, std::index_sequence<Indices...>)
+    {
+      return (payWith<Indices>(amount, cents) || ...);
+    }
+
+    template <std::size_t Index>
+    bool payWith(float amount, std::int64_t cents)
+    {
+      Account& account = std::get<Index>(accounts_);
+      if (account.tryWithdraw(cents)) {
+        LOG("Paid ", amount, " using ", account.getName(), ".");
+        return true;
+      }
+      if (Index + 1 < sizeof...(Accounts)) {
+        LOG("Cannot pay using ", account.getName(), ". Proceeding ...");
+      }
+      return false;
+    }
+
+    // Accounts that plainly can not pay are skipped with a load and a
+    // compare, which stay inlined however long the chain is; only the one
+    // that looks like it can goes through the compare-and-swap.
+    template <std::size_t... Indices>
+    Account* tryPay(std::int64_t cents, std::index_sequence<Indices...>)
+    {
+      Account* paid = nullptr;
+      static_cast<void>((tryPayWith<Indices>(cents, paid) || ...));
+      return paid;
+    }
+
+    template <std::size_t Index>
+    bool tryPayWith(std::int64_t cents, Account*& paid)
+    {
+      Account& account = std::get<Index>(accounts_);
+      if (account.getCents() >= cents && account.tryWithdraw(cents)) {
+        paid = &account;
+        return true;
+      }
+      return false;
+    }
+
+    std::tuple<Accounts...> accounts_;
+};
+
+// Routes payments along a chain of accounts without walking it. The accounts
+// are kept in an array in chain order, under a tree holding the highest
+// balance of every range of them, so the first account that can pay is found
+// in O(log n). Balances changed behind the router's back must be refreshed
+// for it to take them into account, and only one thread may use it at a time.
+class PaymentRouter
+{
+  public:
+    PaymentRouter(std::shared_ptr<Account> head)
+    {
+      for (std::shared_ptr<Account> account = head; account;
+           account = account->getNext()) {
+        accounts_.push_back(account);
+      }
+
+      leaves_ = 1;
+      while (leaves_ < accounts_.size()) {
+        leaves_ *= 2;
+      }
+      maxBalances_.assign(2 * leaves_,
+                          std::numeric_limits<std::int64_t>::min());
+      for (std::size_t i = 0; i < accounts_.size(); ++i) {
+        maxBalances_[leaves_ + i] = accounts_[i]->getCents();
+      }
+      for (std::size_t node = leaves_ - 1; node > 0; --node) {
+        maxBalances_[node] =
+            std::max(maxBalances_[2 * node], maxBalances_[2 * node + 1]);
+      }
+    }
+
+    // Pays with the first account in the chain that can, and returns it, or
+    // nullptr if none can.
+    Account* pay(float amount)
+    {
+      std::int64_t cents = Account::toCents(amount);
+      while (maxBalances_[1] >= cents) {
+        std::size_t node = 1;
+        while (node < leaves_) {
+          node = maxBalances_[2 * node] >= cents ? 2 * node : 2 * node + 1;
+        }
+        std::size_t index = node - leaves_;
+        bool paid = accounts_[index]->tryWithdraw(cents);
+        refresh(index);
+        if (paid) {
+          return accounts_[index].get();
+        }
+      }
+      return nullptr;
+    }
+
+    // Picks up a change made to the balance of the index-th account.
+    void refresh(std::size_t index)
+    {
+      std::size_t node = leaves_ + index;
+      maxBalances_[node] = accounts_[index]->getCents();
+      for (node /= 2; node > 0; node /= 2) {
+        maxBalances_[node] =
+            std::max(maxBalances_[2 * node], maxBalances_[2 * node + 1]);
+      }
+    }
+
+    std::size_t getSize(void) const
+    {
+      return accounts_.size();
+    }
+
+    Account& getAccount(std::size_t index)
+    {
+      return *accounts_[index];
+    }
+
+  private:
+    std::vector<std::shared_ptr<Account>> accounts_;
+    std::size_t leaves_;
+    std::vector<std::int64_t> maxBalances_;
+};
+
 int main()
 {
   // We are going to create the chain: bank->paypal->bitcoin.
@@ -91,5 +446,50 @@ int main()
   // Cannot pay using paypal. Proceeding ...
   // Paid 250 using bitcoin.
 
+  // The same chain, fixed at compile time.
+  Chain<Bank, Paypal, Bitcoin> chain(100, 200, 300);
+  chain.pay(250);
+  // Output:
+  // Cannot pay using bank. Proceeding ...
+  // Cannot pay using paypal. Proceeding ...
+  // Paid 250 using bitcoin.
+  Account* paidBy = chain.tryPay(150);
+  assert(paidBy == &chain.getAccount<1>());
+  paidBy = chain.tryPay(100);
+  assert(paidBy == &chain.getAccount<0>());
+  paidBy = chain.tryPay(60);
+  assert(!paidBy);
+
+  // The same chain, routed without walking it.
+  PaymentRouter router(bank);
+  Account* account = router.pay(30);
+  LOG_FLUSH();
+  std::cout << "Paid 30 using " << account->getName() << "." << std::endl;
+  // Output: Paid 30 using bank.
+
+  // A batch of payments, split over the accounts where needed.
+  std::vector<Charge> charges;
+  std::size_t settled = bank->settle({60, 50, 400}, charges);
+  for (const Charge& charge : charges) {
+    std::cout << "Paid " << charge.cents / 100.0 << " of payment "
+              << charge.payment << " using " << charge.account->getName()
+              << "." << std::endl;
+  }
+  std::cout << settled << " of 3 payments settled." << std::endl;
+  // Output:
+  // Paid 60 of payment 0 using bank.
+  // Paid 10 of payment 1 using bank.
+  // Paid 40 of payment 1 using paypal.
+  // 2 of 3 payments settled.
+
+  // A batch with a payment of nothing, or less, is refused as a whole.
+  try {
+    bank->settle({10, -5}, charges);
+  } catch (const std::invalid_argument& error) {
+    std::cout << error.what() << std::endl;
+  }
+  // Output: Payments must be positive.
+  assert(charges.size() == 3 && bank->getCents() == 0);
+
   return 0;
 }
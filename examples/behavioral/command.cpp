@@ -1,19 +1,89 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../log.h"
 
 // The receiver.
 class Bulb
 {
   public:
+    Bulb(void)
+        : lit_(false)
+    {
+    }
+
     void turnOn(void)
     {
-      std::cout << "Bulb has been lit." << std::endl;
+      lit_ = true;
+      LOG("Bulb has been lit.");
     }
 
     void turnOff(void)
     {
-      std::cout << "Darkness!" << std::endl;
+      lit_ = false;
+      LOG("Darkness!");
+    }
+
+    bool isLit(void) const
+    {
+      return lit_;
+    }
+
+    // Sets the state without a word, e.g. when replaying a journal.
+    void restore(bool lit)
+    {
+      lit_ = lit;
     }
+
+  private:
+    bool lit_;
+};
+
+// What a command does, for invokers that reorder or coalesce commands.
+struct CommandEffect
+{
+  // The object the command acts on. Commands on different receivers can be
+  // reordered; a command without one can not.
+  const void* receiver;
+  // Tags for the kind of change the command makes and the kind of change it
+  // reverts, if any.
+  const void* kind;
+  const void* reverts;
+  // Whether the command sets the whole state of its receiver, whatever it
+  // was, so that the commands on that receiver before it make no difference.
+  bool setsState;
+
+  // Whether a command with the `next` effect, executed right after one with
+  // this effect, reverts it, so that a history can forget both.
+  bool isRevertedBy(const CommandEffect& next) const
+  {
+    return receiver && kind && next.receiver == receiver &&
+           next.reverts == kind;
+  }
 };
 
 class Command
@@ -22,6 +92,16 @@ class Command
     virtual void execute(void) = 0;
     virtual void undo(void) = 0;
     virtual void redo(void) = 0;
+
+    virtual CommandEffect getEffect(void)
+    {
+      return CommandEffect{nullptr, nullptr, nullptr, false};
+    }
+
+    bool isRevertedBy(Command& next)
+    {
+      return getEffect().isRevertedBy(next.getEffect());
+    }
 };
 
 // A command.
@@ -48,6 +128,10 @@ class TurnOn : public Command
       execute();
     }
 
+    CommandEffect getEffect(void);
+
+    static constexpr char kKind = 0;
+
   private:
     std::shared_ptr<Bulb> bulb_;
 };
@@ -76,18 +160,903 @@ class TurnOff : public Command
       execute();
     }
 
+    CommandEffect getEffect(void);
+
+    static constexpr char kKind = 0;
+
   private:
     std::shared_ptr<Bulb> bulb_;
 };
 
+CommandEffect TurnOn::getEffect(void)
+{
+  return CommandEffect{bulb_.get(), &TurnOn::kKind, &TurnOff::kKind, true};
+}
+
+CommandEffect TurnOff::getEffect(void)
+{
+  return CommandEffect{bulb_.get(), &TurnOff::kKind, &TurnOn::kKind, true};
+}
+
+// A command held by value. Anything with execute(), undo() and redo() can be
+// stored; small commands such as TurnOn and TurnOff live in an inline buffer
+// and never touch the heap, larger ones are moved to the heap. It can be
+// moved but not copied, and a moved-from command must not be executed.
+class InlineCommand
+{
+  public:
+    static constexpr std::size_t kBufferSize = 32;
+
+    // An empty command, which must not be executed.
+    InlineCommand(void)
+        : operations_(nullptr)
+    {
+    }
+
+    template <typename T, typename Stored = typename std::decay<T>::type,
+              typename = typename std::enable_if<
+                  !std::is_same<Stored, InlineCommand>::value>::type,
+              typename = decltype(std::declval<Stored&>().execute())>
+    InlineCommand(T&& command)
+        : operations_(operationsFor<Stored>())
+    {
+      if constexpr (isInline<Stored>()) {
+        new (buffer_) Stored(std::forward<T>(command));
+      } else {
+        *reinterpret_cast<Stored**>(buffer_) =
+            new Stored(std::forward<T>(command));
+      }
+    }
+
+    InlineCommand(InlineCommand&& other) noexcept
+        : operations_(other.operations_)
+    {
+      if (operations_) {
+        operations_->move(other.buffer_, buffer_);
+        other.operations_ = nullptr;
+      }
+    }
+
+    InlineCommand& operator=(InlineCommand&& other) noexcept
+    {
+      if (this != &other) {
+        reset();
+        operations_ = other.operations_;
+        if (operations_) {
+          operations_->move(other.buffer_, buffer_);
+          other.operations_ = nullptr;
+        }
+      }
+
+      return *this;
+    }
+
+    InlineCommand(const InlineCommand&) = delete;
+    InlineCommand& operator=(const InlineCommand&) = delete;
+
+    ~InlineCommand(void)
+    {
+      reset();
+    }
+
+    void execute(void)
+    {
+      operations_->execute(buffer_);
+    }
+
+    void undo(void)
+    {
+      operations_->undo(buffer_);
+    }
+
+    void redo(void)
+    {
+      operations_->redo(buffer_);
+    }
+
+    // The effect of the stored command, or none if it does not tell.
+    CommandEffect getEffect(void)
+    {
+      return operations_->getEffect(buffer_);
+    }
+
+    // Whether the command was too large for the buffer and lives on the heap.
+    bool usesHeap(void) const
+    {
+      return operations_ && operations_->usesHeap;
+    }
+
+  private:
+    struct Operations
+    {
+      void (*execute)(void*);
+      void (*undo)(void*);
+      void (*redo)(void*);
+      CommandEffect (*getEffect)(void*);
+      // Moves the command from the first buffer into the second one and
+      // leaves nothing behind to destroy.
+      void (*move)(void*, void*);
+      void (*destroy)(void*);
+      bool usesHeap;
+    };
+
+    template <typename T>
+    static constexpr bool isInline(void)
+    {
+      return sizeof(T) <= kBufferSize &&
+             alignof(T) <= alignof(std::max_align_t) &&
+             std::is_nothrow_move_constructible<T>::value;
+    }
+
+    template <typename T>
+    static T& access(void* buffer)
+    {
+      if constexpr (isInline<T>()) {
+        return *std::launder(reinterpret_cast<T*>(buffer));
+      } else {
+        return **reinterpret_cast<T**>(buffer);
+      }
+    }
+
+    template <typename T>
+    static void executeStored(void* buffer)
+    {
+      access<T>(buffer).execute();
+    }
+
+    template <typename T>
+    static void undoStored(void* buffer)
+    {
+      access<T>(buffer).undo();
+    }
+
+    template <typename T>
+    static void redoStored(void* buffer)
+    {
+      access<T>(buffer).redo();
+    }
+
+    template <typename T, typename = void>
+    struct HasEffect : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct HasEffect<T, std::void_t<decltype(std::declval<T&>().getEffect())>>
+        : std::true_type
+    {
+    };
+
+    template <typename T>
+    static CommandEffect getEffectStored(void* buffer)
+    {
+      if constexpr (HasEffect<T>::value) {
+        return access<T>(buffer).getEffect();
+      } else {
+        return CommandEffect{nullptr, nullptr, nullptr, false};
+      }
+    }
+
+    template <typename T>
+    static void moveStored(void* from, void* to)
+    {
+      if constexpr (isInline<T>()) {
+        new (to) T(std::move(access<T>(from)));
+        access<T>(from).~T();
+      } else {
+        *reinterpret_cast<T**>(to) = *reinterpret_cast<T**>(from);
+      }
+    }
+
+    template <typename T>
+    static void destroyStored(void* buffer)
+    {
+      if constexpr (isInline<T>()) {
+        access<T>(buffer).~T();
+      } else {
+        delete *reinterpret_cast<T**>(buffer);
+      }
+    }
+
+    template <typename T>
+    static const Operations* operationsFor(void)
+    {
+      static const Operations operations = {
+        &executeStored<T>, &undoStored<T>, &redoStored<T>,
+        &getEffectStored<T>, &moveStored<T>, &destroyStored<T>,
+        !isInline<T>()
+      };
+      return &operations;
+    }
+
+    void reset(void)
+    {
+      if (operations_) {
+        operations_->destroy(buffer_);
+        operations_ = nullptr;
+      }
+    }
+
+    const Operations* operations_;
+    alignas(std::max_align_t) unsigned char buffer_[kBufferSize];
+};
+
+// Somewhere to record commands before they are executed, e.g. so that
+// their effects can be rebuilt after a crash.
+class Journal
+{
+  public:
+    virtual ~Journal(void)
+    {
+    }
+
+    // Throws if the command can not be recorded.
+    virtual void append(const CommandEffect& effect) = 0;
+};
+
+// Journaling to a file needs POSIX.
+#ifdef __unix__
+// An append-only log of the commands executed on a set of bulbs, from which
+// their state can be rebuilt after a crash. Each command takes five bytes:
+// the index of its bulb, least significant byte first, and what it did.
+// Records are buffered and written in groups, and made durable every
+// `syncEvery` records (never if 0) and when the journal is committed or
+// closed.
+class CommandJournal : public Journal
+{
+  public:
+    CommandJournal(const std::string& path,
+                   const std::vector<std::shared_ptr<Bulb>>& bulbs,
+                   std::size_t syncEvery)
+        : buffer_(kBufferSize), used_(0), syncEvery_(syncEvery), unsynced_(0)
+    {
+      for (std::size_t i = 0; i < bulbs.size(); ++i) {
+        ids_.emplace(bulbs[i].get(), static_cast<std::uint32_t>(i));
+      }
+
+      fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+      struct stat status;
+      if (fd_ < 0 || ::fstat(fd_, &status) != 0) {
+        closeAndFail(fd_, "Could not open the journal");
+      }
+      if (status.st_size == 0) {
+        std::memcpy(&buffer_[0], kMagic, kHeaderSize);
+        used_ = kHeaderSize;
+        commit();
+      }
+    }
+
+    CommandJournal(const CommandJournal&) = delete;
+    CommandJournal& operator=(const CommandJournal&) = delete;
+
+    ~CommandJournal(void)
+    {
+      try {
+        commit();
+      } catch (const std::runtime_error&) {
+        // Nothing more can be done about it here.
+      }
+      ::close(fd_);
+    }
+
+    // Records a command about to be executed. Throws if it is not a command
+    // on one of the journaled bulbs.
+    void append(const CommandEffect& effect)
+    {
+      std::unordered_map<const void*, std::uint32_t>::const_iterator id =
+          ids_.find(effect.receiver);
+      unsigned char operation = getOperation(effect.kind);
+      if (id == ids_.end() || operation == kUnknown) {
+        throw std::invalid_argument("The command can not be journaled.");
+      }
+
+      if (used_ + kRecordSize > buffer_.size()) {
+        writeBuffer();
+      }
+      for (std::size_t i = 0; i < sizeof(id->second); ++i) {
+        buffer_[used_ + i] = static_cast<char>(id->second >> (8 * i));
+      }
+      buffer_[used_ + sizeof(id->second)] = static_cast<char>(operation);
+      used_ += kRecordSize;
+
+      if (syncEvery_ && ++unsynced_ >= syncEvery_) {
+        commit();
+      }
+    }
+
+    // Writes out everything appended so far and waits until it is durable.
+    void commit(void)
+    {
+      writeBuffer();
+      if (::fdatasync(fd_) != 0) {
+        fail("Could not sync the journal");
+      }
+      unsynced_ = 0;
+    }
+
+    // Rebuilds the state of the bulbs from the journal at `path`, which must
+    // have been written for the same bulbs in the same order. A record cut
+    // short by a crash is ignored. The whole journal is checked before any
+    // bulb is touched, so a corrupt one changes nothing. Returns the number
+    // of records replayed.
+    static std::size_t replay(const std::string& path,
+                              const std::vector<std::shared_ptr<Bulb>>& bulbs)
+    {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      struct stat status;
+      if (fd < 0 || ::fstat(fd, &status) != 0) {
+        closeAndFail(fd, "Could not open the journal");
+      }
+      std::size_t size = static_cast<std::size_t>(status.st_size);
+      if (size < kHeaderSize) {
+        ::close(fd);
+        throw std::runtime_error("The journal has no header.");
+      }
+
+      void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (mapping == MAP_FAILED) {
+        fail("Could not map the journal");
+      }
+      ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+      const unsigned char* data = static_cast<const unsigned char*>(mapping);
+      std::size_t records = (size - kHeaderSize) / kRecordSize;
+      bool valid = std::memcmp(data, kMagic, kHeaderSize) == 0;
+      for (std::size_t i = 0; valid && i < records; ++i) {
+        const unsigned char* record = data + kHeaderSize + i * kRecordSize;
+        valid = readId(record) < bulbs.size() && record[4] < kOperations;
+      }
+      for (std::size_t i = 0; valid && i < records; ++i) {
+        const unsigned char* record = data + kHeaderSize + i * kRecordSize;
+        bulbs[readId(record)]->restore(record[4] == kTurnOn);
+      }
+      ::munmap(mapping, size);
+
+      if (!valid) {
+        throw std::runtime_error("The journal is corrupt.");
+      }
+      return records;
+    }
+
+  private:
+    static constexpr std::size_t kBufferSize = 1024 * 1024;
+    static constexpr std::size_t kHeaderSize = 8;
+    static constexpr std::size_t kRecordSize = 5;
+    static constexpr char kMagic[kHeaderSize + 1] = "CMDJRNL1";
+
+    static constexpr unsigned char kTurnOn = 0;
+    static constexpr unsigned char kTurnOff = 1;
+    static constexpr unsigned char kOperations = 2;
+    static constexpr unsigned char kUnknown = 0xFF;
+
+    static std::uint32_t readId(const unsigned char* record)
+    {
+      return static_cast<std::uint32_t>(record[0]) |
+             static_cast<std::uint32_t>(record[1]) << 8 |
+             static_cast<std::uint32_t>(record[2]) << 16 |
+             static_cast<std::uint32_t>(record[3]) << 24;
+    }
+
+    static unsigned char getOperation(const void* kind)
+    {
+      if (kind == &TurnOn::kKind) {
+        return kTurnOn;
+      }
+      if (kind == &TurnOff::kKind) {
+        return kTurnOff;
+      }
+      return kUnknown;
+    }
+
+    static void fail(const char* what)
+    {
+      throw std::runtime_error(std::string(what) + ": " +
+                               std::strerror(errno) + ".");
+    }
+
+    static void closeAndFail(int fd, const char* what)
+    {
+      int error = errno;
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      errno = error;
+      fail(what);
+    }
+
+    void writeBuffer(void)
+    {
+      std::size_t written = 0;
+      while (written < used_) {
+        ssize_t result = ::write(fd_, &buffer_[written], used_ - written);
+        if (result < 0 && errno != EINTR) {
+          // Keep only what was not written, so that a retry writes no record
+          // twice.
+          int error = errno;
+          std::memmove(&buffer_[0], &buffer_[written], used_ - written);
+          used_ -= written;
+          errno = error;
+          fail("Could not write the journal");
+        }
+        if (result > 0) {
+          written += static_cast<std::size_t>(result);
+        }
+      }
+      used_ = 0;
+    }
+
+    std::unordered_map<const void*, std::uint32_t> ids_;
+    std::vector<char> buffer_;
+    std::size_t used_;
+    std::size_t syncEvery_;
+    std::size_t unsynced_;
+    int fd_;
+};
+#endif
+
 // The invoker.
 class RemoteControl
 {
   public:
+    // Journals every command submitted from now on before executing it.
+    void setJournal(std::shared_ptr<Journal> journal)
+    {
+      journal_ = journal;
+    }
+
     void submit(std::shared_ptr<Command> command)
     {
-      command->execute();
+      run(*command);
+    }
+
+    void submit(InlineCommand command)
+    {
+      if (journal_) {
+        journal_->append(command.getEffect());
+      }
+      command.execute();
+    }
+
+    // Executes a batch of commands grouped by receiver, so that each receiver
+    // is handled in one go. Commands keep their order per receiver, and those
+    // followed by a command that sets the whole state of the same receiver
+    // are skipped, since the last one wins anyway. Commands without a
+    // receiver act as barriers: nothing is moved across them.
+    void submitBatch(const std::vector<std::shared_ptr<Command>>& commands)
+    {
+      // Every receiver keeps the commands still pending for it. One that sets
+      // the state drops them before it is added. Whether it does is rarely
+      // predictable, so the count is reset without a branch.
+      BatchScope scope{*this};
+      for (std::size_t i = 0; i < commands.size(); ++i) {
+        CommandEffect effect = commands[i]->getEffect();
+        if (!effect.receiver) {
+          executePending(commands);
+          run(*commands[i]);
+          continue;
+        }
+
+        Pending& pending = pending_[findGroup(effect.receiver)];
+        pending.count *= !effect.setsState;
+        if (pending.count == pending.commands.size()) {
+          pending.commands.resize(pending.commands.size() * 2);
+        }
+        pending.commands[pending.count++] = i;
+      }
+      executePending(commands);
     }
+
+  private:
+    void run(Command& command)
+    {
+      if (journal_) {
+        journal_->append(command.getEffect());
+      }
+      command.execute();
+    }
+
+    // The indices of the commands still pending for one receiver.
+    struct Pending
+    {
+      Pending(void)
+          : commands(16), count(0)
+      {
+      }
+
+      std::vector<std::size_t> commands;
+      std::size_t count;
+    };
+
+    // Forgets the receivers of a batch when it ends, even if one of its
+    // commands throws.
+    struct BatchScope
+    {
+      RemoteControl& remote;
+
+      ~BatchScope(void)
+      {
+        remote.forgetReceivers();
+      }
+    };
+
+    // Executes what is pending, one receiver after the other, then forgets
+    // the receivers.
+    void executePending(const std::vector<std::shared_ptr<Command>>& commands)
+    {
+      for (std::size_t group = 0; group < groupCount_; ++group) {
+        const Pending& pending = pending_[group];
+        for (std::size_t i = 0; i < pending.count; ++i) {
+          run(*commands[pending.commands[i]]);
+        }
+      }
+      forgetReceivers();
+    }
+
+    // Empties the pending lists and the slots that were used, so that the
+    // cost does not depend on how large the table once grew. The lists keep
+    // their capacity.
+    void forgetReceivers(void)
+    {
+      for (std::size_t group = 0; group < groupCount_; ++group) {
+        pending_[group].count = 0;
+      }
+      groupCount_ = 0;
+      for (std::size_t slot : usedSlots_) {
+        receivers_[slot] = Receiver{nullptr, 0};
+      }
+      usedSlots_.clear();
+    }
+
+    struct Receiver
+    {
+      const void* receiver;
+      std::size_t group;
+    };
+
+    // Returns the dense number of a receiver, giving it the next one if it
+    // is new. Receivers live in a small open addressing table.
+    std::size_t findGroup(const void* receiver)
+    {
+      if (receivers_.empty()) {
+        receivers_.assign(64, Receiver{nullptr, 0});
+      }
+
+      std::size_t mask = receivers_.size() - 1;
+      std::size_t slot = hashReceiver(receiver) & mask;
+      while (receivers_[slot].receiver) {
+        if (receivers_[slot].receiver == receiver) {
+          return receivers_[slot].group;
+        }
+        slot = (slot + 1) & mask;
+      }
+
+      std::size_t group = groupCount_++;
+      receivers_[slot] = Receiver{receiver, group};
+      usedSlots_.push_back(slot);
+      if (pending_.size() < groupCount_) {
+        pending_.resize(groupCount_);
+      }
+      if (groupCount_ * 2 > receivers_.size()) {
+        growReceivers();
+      }
+      return group;
+    }
+
+    static std::size_t hashReceiver(const void* receiver)
+    {
+      std::uint64_t bits = reinterpret_cast<std::uintptr_t>(receiver);
+      return static_cast<std::size_t>((bits * 0x9E3779B97F4A7C15ULL) >> 20);
+    }
+
+    void growReceivers(void)
+    {
+      std::vector<Receiver> old(receivers_.size() * 2, Receiver{nullptr, 0});
+      old.swap(receivers_);
+      std::size_t mask = receivers_.size() - 1;
+      usedSlots_.clear();
+      for (const Receiver& entry : old) {
+        if (entry.receiver) {
+          std::size_t slot = hashReceiver(entry.receiver) & mask;
+          while (receivers_[slot].receiver) {
+            slot = (slot + 1) & mask;
+          }
+          receivers_[slot] = entry;
+          usedSlots_.push_back(slot);
+        }
+      }
+    }
+
+    std::shared_ptr<Journal> journal_;
+
+    // Scratch space kept between batches.
+    std::vector<Pending> pending_;
+    std::size_t groupCount_ = 0;
+    std::vector<Receiver> receivers_;
+    std::vector<std::size_t> usedSlots_;
+};
+
+// An invoker that remembers what it executed so that it can be undone and
+// redone. The history is a ring of commands held by value, allocated up front
+// from a memory limit; once it is full the oldest commands are forgotten.
+// Only commands small enough to be held inline are accepted, so that the
+// limit is all the memory the history takes. A command that reverts the
+// previous one (e.g. turning a bulb off right after turning it on) removes
+// that command from the history instead of being added to it.
+class UndoableRemoteControl
+{
+  public:
+    UndoableRemoteControl(std::size_t memoryLimit)
+        : history_(std::max<std::size_t>(1, memoryLimit / sizeof(Entry))),
+          oldest_(0), done_(0), recorded_(0)
+    {
+    }
+
+    // Throws without executing the command if it is too large to be kept.
+    void submit(InlineCommand command)
+    {
+      if (command.usesHeap()) {
+        throw std::invalid_argument("The command is too large to be undone.");
+      }
+
+      command.execute();
+      if (done_ > 0 &&
+          at(done_ - 1).getEffect().isRevertedBy(command.getEffect())) {
+        --done_;
+        at(done_) = Entry();
+        recorded_ = done_;
+        return;
+      }
+
+      if (done_ == history_.size()) {
+        at(0) = Entry();
+        oldest_ = (oldest_ + 1) % history_.size();
+        --done_;
+      }
+      at(done_) = std::move(command);
+      ++done_;
+      // Anything that could have been redone is overwritten lazily.
+      recorded_ = done_;
+    }
+
+    // Both return false when there is nothing to undo or redo.
+    bool undo(void)
+    {
+      if (done_ == 0) {
+        return false;
+      }
+
+      --done_;
+      at(done_).undo();
+      return true;
+    }
+
+    bool redo(void)
+    {
+      if (done_ == recorded_) {
+        return false;
+      }
+
+      at(done_).redo();
+      ++done_;
+      return true;
+    }
+
+    // The number of commands that can currently be undone.
+    std::size_t getHistorySize(void) const
+    {
+      return done_;
+    }
+
+    std::size_t getHistoryCapacity(void) const
+    {
+      return history_.size();
+    }
+
+  private:
+    typedef InlineCommand Entry;
+
+    Entry& at(std::size_t index)
+    {
+      return history_[(oldest_ + index) % history_.size()];
+    }
+
+    std::vector<Entry> history_;
+    std::size_t oldest_;
+    std::size_t done_;
+    std::size_t recorded_;
+};
+
+// A bounded queue that many threads can push to and a single thread pops
+// from, without locks. Every cell carries a sequence number that tells
+// producers when it is free and the consumer when it has been filled.
+template <typename T>
+class MpscRing
+{
+  public:
+    MpscRing(std::size_t capacity)
+        : cells_(roundUpToPowerOfTwo(capacity)), mask_(cells_.size() - 1),
+          enqueuePosition_(0), dequeuePosition_(0)
+    {
+      for (std::size_t i = 0; i < cells_.size(); ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    // Returns false if the ring is full.
+    bool tryPush(T& value)
+    {
+      std::size_t position = enqueuePosition_.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = cells_[position & mask_];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) -
+                                    static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+          if (enqueuePosition_.compare_exchange_weak(
+                  position, position + 1, std::memory_order_relaxed)) {
+            cell.value = std::move(value);
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (difference < 0) {
+          return false;
+        } else {
+          position = enqueuePosition_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // Moves up to `count` values into `values` and returns how many it took.
+    // Only one thread may pop.
+    std::size_t popBatch(T* values, std::size_t count)
+    {
+      std::size_t taken = 0;
+      for (; taken < count; ++taken) {
+        Cell& cell = cells_[dequeuePosition_ & mask_];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != dequeuePosition_ + 1) {
+          break;
+        }
+        values[taken] = std::move(cell.value);
+        cell.sequence.store(dequeuePosition_ + cells_.size(),
+                            std::memory_order_release);
+        ++dequeuePosition_;
+      }
+
+      return taken;
+    }
+
+  private:
+    struct alignas(64) Cell
+    {
+      std::atomic<std::size_t> sequence;
+      T value;
+    };
+
+    static std::size_t roundUpToPowerOfTwo(std::size_t value)
+    {
+      std::size_t power = 2;
+      while (power < value) {
+        power *= 2;
+      }
+
+      return power;
+    }
+
+    std::vector<Cell> cells_;
+    const std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> enqueuePosition_;
+    alignas(64) std::size_t dequeuePosition_;
+};
+
+// What AsyncRemoteControl::submit does when its queue is full.
+enum class Backpressure
+{
+  // Wait until the worker makes room.
+  Block,
+  // Discard the command and count it as dropped.
+  Drop,
+  // Throw std::overflow_error.
+  Fail
+};
+
+// An invoker that queues commands and executes them on a worker thread, in
+// the order they were queued. The worker takes the queued commands in batches
+// of up to `batchSize`.
+class AsyncRemoteControl
+{
+  public:
+    AsyncRemoteControl(std::size_t capacity, Backpressure backpressure,
+                       std::size_t batchSize = 64)
+        : queue_(capacity), backpressure_(backpressure),
+          batchSize_(batchSize ? batchSize : 1), submitted_(0), executed_(0),
+          dropped_(0), stopping_(false)
+    {
+      worker_ = std::thread(&AsyncRemoteControl::run, this);
+    }
+
+    // Executes everything still queued before returning.
+    ~AsyncRemoteControl(void)
+    {
+      stopping_.store(true, std::memory_order_release);
+      worker_.join();
+    }
+
+    // Returns false if the command was dropped.
+    bool submit(std::shared_ptr<Command> command)
+    {
+      // Counted before it is queued, so that a drain() that follows can not
+      // miss it. A command that is not queued after all counts as executed.
+      submitted_.fetch_add(1, std::memory_order_release);
+      while (!queue_.tryPush(command)) {
+        if (backpressure_ == Backpressure::Drop) {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          executed_.fetch_add(1, std::memory_order_release);
+          return false;
+        }
+        if (backpressure_ == Backpressure::Fail) {
+          executed_.fetch_add(1, std::memory_order_release);
+          throw std::overflow_error("The command queue is full.");
+        }
+        std::this_thread::yield();
+      }
+
+      return true;
+    }
+
+    // Waits until every command submitted so far has been executed.
+    void drain(void)
+    {
+      std::size_t submitted = submitted_.load(std::memory_order_acquire);
+      while (executed_.load(std::memory_order_acquire) < submitted) {
+        std::this_thread::yield();
+      }
+    }
+
+    std::size_t getDroppedCount(void)
+    {
+      return dropped_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr int kSpinsBeforeSleep = 1024;
+
+    void run(void)
+    {
+      std::vector<std::shared_ptr<Command>> batch(batchSize_);
+      int idle = 0;
+      for (;;) {
+        // Read the flag first so that nothing queued before it was set is
+        // left behind.
+        bool stopping = stopping_.load(std::memory_order_acquire);
+        std::size_t count = queue_.popBatch(batch.data(), batch.size());
+        for (std::size_t i = 0; i < count; ++i) {
+          batch[i]->execute();
+          batch[i].reset();
+        }
+        if (count) {
+          executed_.fetch_add(count, std::memory_order_release);
+          idle = 0;
+        } else if (stopping) {
+          return;
+        } else if (++idle < kSpinsBeforeSleep) {
+          std::this_thread::yield();
+        } else {
+          // Nothing has come in for a while; stop burning a core.
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+    }
+
+    MpscRing<std::shared_ptr<Command>> queue_;
+    Backpressure backpressure_;
+    std::size_t batchSize_;
+    std::atomic<std::size_t> submitted_;
+    std::atomic<std::size_t> executed_;
+    std::atomic<std::size_t> dropped_;
+    std::atomic<bool> stopping_;
+    std::thread worker_;
 };
 
 int main()
@@ -104,5 +1073,87 @@ int main()
   // Bulb has been lit.
   // Darkness!
 
+  // The same commands, executed on a worker thread.
+  AsyncRemoteControl asyncRemote(1024, Backpressure::Block);
+  asyncRemote.submit(turnOn);
+  asyncRemote.submit(turnOff);
+  asyncRemote.drain();
+  // Output:
+  // Bulb has been lit.
+  // Darkness!
+
+  // Commands can also be submitted by value, without any allocation.
+  remote.submit(InlineCommand(TurnOn(bulb)));
+  // Output: Bulb has been lit.
+
+  // In a batch only the last command for each bulb is executed.
+  remote.submitBatch({turnOn, turnOff, turnOn});
+  // Output: Bulb has been lit.
+
+  // Whether the bulb was lit or not, a batch leaves it as submitting the same
+  // commands one by one does.
+  for (bool lit : {false, true}) {
+    bulb->restore(lit);
+    remote.submitBatch({turnOn, turnOff});
+    bool batched = bulb->isLit();
+    bulb->restore(lit);
+    remote.submit(turnOn);
+    remote.submit(turnOff);
+    assert(batched == bulb->isLit());
+  }
+  // Output, twice:
+  // Darkness!
+  // Bulb has been lit.
+  // Darkness!
+
+  // An invoker that can take things back.
+  UndoableRemoteControl undoableRemote(1024);
+  undoableRemote.submit(TurnOn(bulb));
+  undoableRemote.undo();
+  undoableRemote.redo();
+  // Output:
+  // Bulb has been lit.
+  // Darkness!
+  // Bulb has been lit.
+
+  // Turning the bulb off right away cancels the previous command.
+  undoableRemote.submit(TurnOff(bulb));
+  LOG_FLUSH();
+  std::cout << undoableRemote.getHistorySize() << std::endl;
+  // Output:
+  // Darkness!
+  // 0
+
+#ifdef __unix__
+  // Journaled commands survive the bulbs they were executed on.
+  char path[] = "/tmp/remote_control.XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  ::close(fd);
+  {
+    std::shared_ptr<CommandJournal> journal =
+        std::make_shared<CommandJournal>(
+            path, std::vector<std::shared_ptr<Bulb>>{bulb}, 64);
+    remote.setJournal(journal);
+    remote.submit(turnOn);
+    remote.submit(turnOff);
+    remote.submit(InlineCommand(TurnOn(bulb)));
+    remote.setJournal(nullptr);
+  }
+  // Output:
+  // Bulb has been lit.
+  // Darkness!
+  // Bulb has been lit.
+
+  std::shared_ptr<Bulb> recovered = std::make_shared<Bulb>();
+  std::size_t replayed = CommandJournal::replay(path, {recovered});
+  LOG_FLUSH();
+  std::cout << replayed << " " << recovered->isLit() << std::endl;
+  ::unlink(path);
+  // Output: 3 1
+#endif
+
   return 0;
 }
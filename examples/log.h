@@ -0,0 +1,427 @@
+// A small logging sink shared by the examples whose handlers sit on hot paths.
+//
+//   LOG("Paid ", amount, " using ", name, ".");
+//
+// writes one line. The call only copies its arguments into a buffer owned by
+// the calling thread; a background thread formats them and writes whole
+// batches of lines at once. Lines from one thread keep their order; lines from
+// different threads are only roughly in the order they were logged. Strings
+// given as `const char*` are kept by pointer and must outlive the write
+// (string literals do); anything else is copied.
+//
+// LOG_FLUSH() waits until the lines logged so far by the calling thread have
+// been written, e.g. before printing to std::cout after them.
+//
+// Building with -DLOGGING_DISABLED turns every LOG() into nothing, arguments
+// included, and LOG_FLUSH() too.
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace logging
+{
+
+inline void append(std::string& line, const char* text)
+{
+  line += text;
+}
+
+inline void append(std::string& line, const std::string& text)
+{
+  line += text;
+}
+
+inline void append(std::string& line, std::string_view text)
+{
+  line += text;
+}
+
+inline void append(std::string& line, char character)
+{
+  line += character;
+}
+
+inline void append(std::string& line, bool value)
+{
+  line += value ? '1' : '0';
+}
+
+// Like std::ostream with its default flags, i.e. printf("%g").
+inline void append(std::string& line, double value)
+{
+  char text[32];
+  std::to_chars_result result = std::to_chars(
+      text, text + sizeof(text), value, std::chars_format::general, 6);
+  line.append(text, result.ptr);
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value>::type
+append(std::string& line, T value)
+{
+  char text[24];
+  std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+  line.append(text, result.ptr);
+}
+
+// A record in a thread's buffer: how to format what follows it.
+struct alignas(32) Header
+{
+  // Formats the arguments stored after the header into a line and destroys
+  // them, or nullptr for the padding that fills the end of the buffer.
+  void (*format)(unsigned char*, std::string&);
+  std::uint64_t sequence;
+  std::uint32_t size;
+};
+
+template <typename Arguments>
+void format(unsigned char* payload, std::string& line)
+{
+  Arguments* arguments = reinterpret_cast<Arguments*>(payload);
+  std::apply([&line](const auto&... argument) {
+    (append(line, argument), ...);
+  }, *arguments);
+  line += '\n';
+  arguments->~Arguments();
+}
+
+// A ring of records written by one thread and read by the flusher.
+class Buffer
+{
+  public:
+    static constexpr std::size_t kCapacity = 64 * 1024;
+
+    Buffer(void)
+        : data_(static_cast<unsigned char*>(::operator new(
+              kCapacity, std::align_val_t{alignof(Header)}))),
+          head_(0), tail_(0), closed_(false)
+    {
+    }
+
+    // Where to write a record of `size` bytes, which must then be published.
+    // Returns nullptr while there is no room.
+    unsigned char* reserve(std::size_t size)
+    {
+      std::size_t head = head_.load(std::memory_order_relaxed);
+      std::size_t offset = head % kCapacity;
+      std::size_t padding = kCapacity - offset < size ? kCapacity - offset : 0;
+      if (kCapacity - (head - tail_.load(std::memory_order_acquire)) <
+          padding + size) {
+        return nullptr;
+      }
+
+      if (padding) {
+        new (&data_[offset]) Header{nullptr, 0,
+                                    static_cast<std::uint32_t>(padding)};
+        reserved_ = head + padding;
+        return &data_[0];
+      }
+      reserved_ = head;
+      return &data_[offset];
+    }
+
+    void publish(std::size_t size)
+    {
+      head_.store(reserved_ + size, std::memory_order_release);
+    }
+
+    // The next record to read, or nullptr if there is none up to `head`.
+    Header* peek(std::size_t head)
+    {
+      while (tail_.load(std::memory_order_relaxed) != head) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        Header* header = reinterpret_cast<Header*>(&data_[tail % kCapacity]);
+        if (header->format) {
+          return header;
+        }
+        tail_.store(tail + header->size, std::memory_order_release);
+      }
+      return nullptr;
+    }
+
+    void pop(const Header& header)
+    {
+      tail_.fetch_add(header.size, std::memory_order_release);
+    }
+
+    std::size_t getHead(void) const
+    {
+      return head_.load(std::memory_order_acquire);
+    }
+
+    bool isEmpty(void) const
+    {
+      return getHead() == tail_.load(std::memory_order_relaxed);
+    }
+
+    // Set once the thread that writes the buffer is gone.
+    void close(void)
+    {
+      closed_.store(true, std::memory_order_release);
+    }
+
+    bool isClosed(void) const
+    {
+      return closed_.load(std::memory_order_acquire);
+    }
+
+  private:
+    // The records are placed at multiples of sizeof(Header) into the data, so
+    // it must be as aligned as a Header.
+    struct Delete
+    {
+      void operator()(unsigned char* data) const
+      {
+        ::operator delete(data, std::align_val_t{alignof(Header)});
+      }
+    };
+
+    std::unique_ptr<unsigned char[], Delete> data_;
+    alignas(64) std::atomic<std::size_t> head_;
+    std::size_t reserved_;
+    alignas(64) std::atomic<std::size_t> tail_;
+    std::atomic<bool> closed_;
+};
+
+class Sink
+{
+  public:
+    static Sink& getInstance(void)
+    {
+      static Sink sink;
+      return sink;
+    }
+
+    Sink(const Sink&) = delete;
+    Sink& operator=(const Sink&) = delete;
+
+    ~Sink(void)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      wake_.notify_one();
+      flusher_.join();
+    }
+
+    template <typename... Arguments>
+    void log(Arguments&&... arguments)
+    {
+      typedef std::tuple<typename std::decay<Arguments>::type...> payload_t;
+      static_assert(alignof(payload_t) <= alignof(Header),
+                    "The arguments are too aligned to be logged.");
+      constexpr std::size_t size =
+          (sizeof(Header) + sizeof(payload_t) + sizeof(Header) - 1) /
+          sizeof(Header) * sizeof(Header);
+      static_assert(size <= Buffer::kCapacity / 2,
+                    "The arguments are too large to be logged.");
+
+      Buffer& buffer = getLocalBuffer();
+      unsigned char* record = buffer.reserve(size);
+      if (!record) {
+        // The flusher is behind: wake it up and get out of its way.
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          flushRequested_ = true;
+        }
+        wake_.notify_one();
+        do {
+          std::this_thread::yield();
+          record = buffer.reserve(size);
+        } while (!record);
+      }
+      new (record) Header{&format<payload_t>,
+                          sequence_.fetch_add(1, std::memory_order_relaxed),
+                          static_cast<std::uint32_t>(size)};
+      new (record + sizeof(Header))
+          payload_t(std::forward<Arguments>(arguments)...);
+      buffer.publish(size);
+    }
+
+    // Waits until everything logged so far by this thread has been written.
+    void flush(void)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // The pass under way may have missed the latest lines; wait for the
+      // next one to end.
+      std::uint64_t wanted = passes_ + 2;
+      flushRequested_ = true;
+      wake_.notify_one();
+      flushed_.wait(lock, [this, wanted]() { return passes_ >= wanted; });
+    }
+
+    // Sends the lines to another file descriptor (1 by default).
+    void setOutput(int fd)
+    {
+      flush();
+      output_.store(fd, std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr std::chrono::milliseconds kInterval{1};
+
+    Sink(void)
+        : sequence_(0), output_(STDOUT_FILENO), stopping_(false),
+          flushRequested_(false), passes_(0)
+    {
+      flusher_ = std::thread(&Sink::run, this);
+    }
+
+    // Registers a buffer for the calling thread the first time it logs and
+    // closes it when the thread exits.
+    Buffer& getLocalBuffer(void)
+    {
+      struct Registration
+      {
+        Registration(Sink& sink)
+            : buffer(std::make_shared<Buffer>())
+        {
+          std::lock_guard<std::mutex> lock(sink.mutex_);
+          sink.buffers_.push_back(buffer);
+        }
+
+        ~Registration(void)
+        {
+          buffer->close();
+        }
+
+        std::shared_ptr<Buffer> buffer;
+      };
+
+      thread_local Registration registration(*this);
+      return *registration.buffer;
+    }
+
+    void run(void)
+    {
+      std::vector<std::shared_ptr<Buffer>> buffers;
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        wake_.wait_for(lock, kInterval, [this]() {
+          return stopping_ || flushRequested_;
+        });
+        bool stopping = stopping_;
+        flushRequested_ = false;
+        buffers = buffers_;
+        lock.unlock();
+
+        drain(buffers);
+
+        lock.lock();
+        buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                      [](const std::shared_ptr<Buffer>& b) {
+                                        return b->isClosed() && b->isEmpty();
+                                      }),
+                       buffers_.end());
+        ++passes_;
+        flushed_.notify_all();
+        if (stopping) {
+          return;
+        }
+      }
+    }
+
+    // Formats every record published so far, merging the buffers by
+    // sequence number, and writes them out in one go.
+    void drain(const std::vector<std::shared_ptr<Buffer>>& buffers)
+    {
+      heads_.resize(buffers.size());
+      for (std::size_t i = 0; i < buffers.size(); ++i) {
+        heads_[i] = buffers[i]->getHead();
+      }
+
+      text_.clear();
+      while (true) {
+        Buffer* next = nullptr;
+        Header* first = nullptr;
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+          Header* header = buffers[i]->peek(heads_[i]);
+          if (header && (!first || header->sequence < first->sequence)) {
+            next = buffers[i].get();
+            first = header;
+          }
+        }
+        if (!first) {
+          break;
+        }
+        first->format(reinterpret_cast<unsigned char*>(first + 1), text_);
+        next->pop(*first);
+      }
+
+      write(text_);
+    }
+
+    void write(const std::string& text)
+    {
+      int fd = output_.load(std::memory_order_relaxed);
+      std::size_t written = 0;
+      while (written < text.size()) {
+        ssize_t result = ::write(fd, text.data() + written,
+                                 text.size() - written);
+        if (result < 0 && errno != EINTR) {
+          return;
+        }
+        if (result > 0) {
+          written += static_cast<std::size_t>(result);
+        }
+      }
+    }
+
+    std::atomic<std::uint64_t> sequence_;
+    std::atomic<int> output_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    std::vector<std::shared_ptr<Buffer>> buffers_;
+    bool stopping_;
+    bool flushRequested_;
+    std::uint64_t passes_;
+    std::thread flusher_;
+
+    // Only used by the flusher.
+    std::vector<std::size_t> heads_;
+    std::string text_;
+};
+
+} // namespace logging
+
+#ifdef LOGGING_DISABLED
+namespace logging
+{
+// Only named in unevaluated context, so that the arguments still count as
+// used without being evaluated.
+template <typename... Arguments>
+int discard(const Arguments&...);
+} // namespace logging
+
+#define LOG(...) ((void)sizeof(::logging::discard(__VA_ARGS__)))
+#define LOG_FLUSH() ((void)0)
+#else
+#define LOG(...) ::logging::Sink::getInstance().log(__VA_ARGS__)
+#define LOG_FLUSH() ::logging::Sink::getInstance().flush()
+#endif
+
+#endif // LOG_H
@@ -1,5 +1,10 @@
+#include <assert.h>
 #include <iostream>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 class Lion
 {
@@ -7,7 +12,7 @@ class Lion
     virtual void roar(void) = 0;
 };
 
-class AfricanLion : public Lion
+class AfricanLion final : public Lion
 {
   public:
     void roar(void)
@@ -16,7 +21,7 @@ class AfricanLion : public Lion
     }
 };
 
-class AsianLion : public Lion
+class AsianLion final : public Lion
 {
   public:
     void roar(void)
@@ -25,6 +30,19 @@ class AsianLion : public Lion
     }
 };
 
+// Whether an Animal can be hunted, i.e. has a roar(), whether or not it is a
+// Lion.
+template <typename Animal, typename = void>
+struct CanRoar : std::false_type
+{
+};
+
+template <typename Animal>
+struct CanRoar<Animal, std::void_t<decltype(std::declval<Animal&>().roar())>>
+    : std::true_type
+{
+};
+
 class Hunter
 {
   public:
@@ -32,6 +50,25 @@ class Hunter
     {
       lion.roar();
     }
+
+    // Hunts an animal whose type is known at compile time, without going
+    // through the Lion interface.
+    template <typename Animal>
+    typename std::enable_if<CanRoar<Animal>::value>::type hunt(Animal& animal)
+    {
+      animal.roar();
+    }
+
+    // Hunts every animal of a mixed pack kept side by side in one vector.
+    // Returns the number of animals hunted.
+    template <typename... Animals>
+    std::size_t hunt(std::vector<std::variant<Animals...>>& animals)
+    {
+      for (std::variant<Animals...>& animal : animals) {
+        std::visit([this](auto& known) { hunt(known); }, animal);
+      }
+      return animals.size();
+    }
 };
 
 class WildDog
@@ -60,6 +97,26 @@ class WildDogAdapter : public Lion
     std::shared_ptr<WildDog> dog_;
 };
 
+// Makes a Dog roar like a lion when its type is known at compile time: it is
+// held by value and not through a Lion, so roaring is a direct call.
+template <typename Dog>
+class StaticWildDogAdapter
+{
+  public:
+    StaticWildDogAdapter(Dog dog = Dog())
+        : dog_(std::move(dog))
+    {
+    }
+
+    void roar(void)
+    {
+      dog_.bark();
+    }
+
+  private:
+    Dog dog_;
+};
+
 int main()
 {
   std::shared_ptr<WildDog> wildDog = std::make_shared<WildDog>();
@@ -68,5 +125,21 @@ int main()
   Hunter hunter;
   hunter.hunt(wildDogAdapter); // Output: *wild dog bark*
 
+  StaticWildDogAdapter<WildDog> staticWildDogAdapter;
+  static_assert(!std::is_polymorphic<StaticWildDogAdapter<WildDog>>::value,
+                "A static adapter needs no virtual table.");
+  hunter.hunt(staticWildDogAdapter); // Output: *wild dog bark*
+
+  // A mixed pack, hunted in one go.
+  std::vector<std::variant<AfricanLion, AsianLion, WildDogAdapter>> pack;
+  pack.emplace_back(AfricanLion());
+  pack.emplace_back(AsianLion());
+  pack.emplace_back(WildDogAdapter(wildDog));
+  const std::size_t hunted = hunter.hunt(pack);
+  assert(hunted == 3);
+  // Output: *African lion roar*
+  // Output: *Asian lion roar*
+  // Output: *wild dog bark*
+
   return 0;
 }
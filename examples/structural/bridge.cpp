@@ -1,51 +1,78 @@
+#include <assert.h>
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
 
 class Theme
 {
   public:
-    virtual std::string getColor(void) = 0;
+    // The palette is a constant that outlives the theme.
+    virtual std::string_view getColor(void) = 0;
 };
 
 class WebPage
 {
   public:
+    WebPage(std::shared_ptr<Theme> theme)
+        : theme_(theme)
+    {
+    }
+
     virtual std::string getContent(void) = 0;
+
+    // The theme can be switched while other threads render the page.
+    std::shared_ptr<Theme> getTheme(void) const
+    {
+      return std::atomic_load(&theme_);
+    }
+
+    void setTheme(std::shared_ptr<Theme> theme)
+    {
+      std::atomic_store(&theme_, theme);
+    }
+
+  private:
+    std::shared_ptr<Theme> theme_;
 };
 
 class About : public WebPage
 {
   public:
     About(std::shared_ptr<Theme> theme)
-        : theme_(theme)
+        : WebPage(theme)
     {
     }
 
     std::string getContent(void)
     {
-      return "About page in " + theme_->getColor();
+      std::string content = "About page in ";
+      content += getTheme()->getColor();
+      return content;
     }
-
-  private:
-    std::shared_ptr<Theme> theme_;
 };
 
 class Projects : public WebPage
 {
   public:
     Projects(std::shared_ptr<Theme> theme)
-        : theme_(theme)
+        : WebPage(theme)
     {
     }
 
     std::string getContent(void)
     {
-      return "Projects page in " + theme_->getColor();
+      std::string content = "Projects page in ";
+      content += getTheme()->getColor();
+      return content;
     }
-
-  private:
-    std::shared_ptr<Theme> theme_;
 };
 
 
@@ -53,44 +80,165 @@ class Careers : public WebPage
 {
   public:
     Careers(std::shared_ptr<Theme> theme)
-        : theme_(theme)
+        : WebPage(theme)
     {
     }
 
     std::string getContent(void)
     {
-      return "Careers page in " + theme_->getColor();
+      std::string content = "Careers page in ";
+      content += getTheme()->getColor();
+      return content;
     }
-
-  private:
-    std::shared_ptr<Theme> theme_;
 };
 
 class DarkTheme : public Theme
 {
   public:
-    std::string getColor(void)
+    static constexpr std::string_view kPalette = "dark palette";
+
+    std::string_view getColor(void)
     {
-      return "dark palette";
+      return kPalette;
     }
 };
 
 class LightTheme : public Theme
 {
   public:
-    std::string getColor(void)
+    static constexpr std::string_view kPalette = "light palette";
+
+    std::string_view getColor(void)
     {
-      return "light palette";
+      return kPalette;
     }
 };
 
 class AquaTheme : public Theme
 {
   public:
-    std::string getColor(void)
+    static constexpr std::string_view kPalette = "aqua palette";
+
+    std::string_view getColor(void)
+    {
+      return kPalette;
+    }
+};
+
+// Renders each kind of page once per theme and hands the same immutable
+// content to every later request for it, from any number of threads. The
+// theme is part of the key, so a page whose theme is switched is rendered
+// afresh instead of being served in its old theme. Pages rendered in themes
+// that have since been destroyed are dropped as the cache grows.
+class RenderCache
+{
+  public:
+    typedef std::shared_ptr<const std::string> content_t;
+
+    RenderCache(void)
+        : sweepAt_(kFirstSweep)
+    {
+    }
+
+    content_t getContent(WebPage& page)
+    {
+      std::shared_ptr<Theme> theme = page.getTheme();
+      Key key{std::type_index(typeid(page)), theme.get()};
+      {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        std::unordered_map<Key, Entry, KeyHash>::const_iterator entry =
+            entries_.find(key);
+        if (entry != entries_.end() && !entry->second.theme.expired()) {
+          return entry->second.content;
+        }
+      }
+
+      // Rendered without the lock. A page whose theme was switched meanwhile
+      // may have been rendered in either theme, so it is not kept.
+      content_t content = std::make_shared<const std::string>(
+          page.getContent());
+      if (page.getTheme() != theme) {
+        return content;
+      }
+
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      if (entries_.size() >= sweepAt_) {
+        sweep();
+      }
+      // If another thread got there first, its content is kept, unless it
+      // was rendered in a destroyed theme that happened to live at the same
+      // address.
+      std::pair<std::unordered_map<Key, Entry, KeyHash>::iterator, bool>
+          inserted = entries_.emplace(key, Entry{theme, content});
+      if (!inserted.second && inserted.first->second.theme.expired()) {
+        inserted.first->second = Entry{theme, content};
+      }
+      return inserted.first->second.content;
+    }
+
+    // Drops every rendered page.
+    void clear(void)
     {
-      return "aqua palette";
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      entries_.clear();
     }
+
+    std::size_t getSize(void)
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      return entries_.size();
+    }
+
+  private:
+    static constexpr std::size_t kFirstSweep = 64;
+
+    struct Key
+    {
+      std::type_index page;
+      const Theme* theme;
+
+      bool operator==(const Key& other) const
+      {
+        return page == other.page && theme == other.theme;
+      }
+    };
+
+    // Equal page types always hash alike, even if a type has several
+    // type_info objects.
+    struct KeyHash
+    {
+      std::size_t operator()(const Key& key) const
+      {
+        return std::hash<std::type_index>()(key.page) * 31 +
+               std::hash<const Theme*>()(key.theme);
+      }
+    };
+
+    struct Entry
+    {
+      // Tells whether the theme at the address in the key is still the one
+      // the page was rendered in, without keeping it alive.
+      std::weak_ptr<Theme> theme;
+      content_t content;
+    };
+
+    // Drops the pages rendered in destroyed themes. Called with the lock held
+    // for writing.
+    void sweep(void)
+    {
+      for (auto entry = entries_.begin(); entry != entries_.end();) {
+        if (entry->second.theme.expired()) {
+          entry = entries_.erase(entry);
+        } else {
+          ++entry;
+        }
+      }
+      sweepAt_ = std::max(kFirstSweep, 2 * entries_.size());
+    }
+
+    std::shared_mutex mutex_;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+    std::size_t sweepAt_;
 };
 
 int main()
@@ -104,5 +252,28 @@ int main()
   std::cout << careers.getContent() << std::endl;
   // Output: Careers page in dark palette
 
+  // Pages of the same kind and theme share one rendering.
+  RenderCache cache;
+  About otherAbout(darkTheme);
+  RenderCache::content_t content = cache.getContent(about);
+  assert(*content == "About page in dark palette");
+  assert(cache.getContent(otherAbout) == content);
+  assert(cache.getContent(careers) != content);
+  assert(cache.getSize() == 2);
+
+  // Switching themes renders the page again.
+  about.setTheme(std::make_shared<AquaTheme>());
+  std::cout << *cache.getContent(about) << std::endl;
+  // Output: About page in aqua palette
+  assert(*cache.getContent(otherAbout) == "About page in dark palette");
+
+  // Once the aqua theme is gone, its page is never served again, and it is
+  // dropped when the cache sweeps.
+  about.setTheme(darkTheme);
+  assert(cache.getContent(about) == content);
+  assert(cache.getSize() == 3);
+  cache.clear();
+  assert(cache.getSize() == 0);
+
   return 0;
 }
@@ -1,11 +1,25 @@
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPOSITE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 class Employee
 {
   public:
+    // Employees are owned and deleted through this class.
+    virtual ~Employee(void) = default;
+
     virtual std::string getName(void) = 0;
     virtual void setSalary(float salary) = 0;
     virtual float getSalary(void) = 0;
@@ -80,6 +94,55 @@ class Designer : public Employee
     std::string role_;
 };
 
+// Salaries are added up as whole cents. Integer addition does not depend on
+// the order of the operands, so a parallel sum gives the exact same result
+// whatever the number of threads.
+inline std::int64_t toCents(float salary)
+{
+  double cents = static_cast<double>(salary) * 100;
+  return static_cast<std::int64_t>(cents < 0 ? cents - 0.5 : cents + 0.5);
+}
+
+// Below this many employees per thread, starting a thread costs more than
+// it saves.
+static const std::size_t kMinEmployeesPerThread = 1 << 16;
+
+// Splits [0, count) into one contiguous chunk per thread, sums each chunk
+// with `centsInRange(begin, end)` and combines the partial sums. Small counts
+// are summed on the calling thread alone.
+template <typename Function>
+double sumCentsInParallel(std::size_t count, unsigned threads,
+                          Function centsInRange)
+{
+  std::size_t useful = count / kMinEmployeesPerThread;
+  if (threads > useful) {
+    threads = static_cast<unsigned>(useful);
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+
+  std::vector<std::int64_t> partial(threads, 0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      partial[t] = centsInRange(count * t / threads,
+                                count * (t + 1) / threads);
+    });
+  }
+  partial[0] = centsInRange(0, count / threads);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  std::int64_t cents = 0;
+  for (auto sum : partial) {
+    cents += sum;
+  }
+
+  return cents / 100.0;
+}
+
 class Organization
 {
   public:
@@ -98,10 +161,415 @@ class Organization
       return net;
     }
 
+    // Sums the salaries on `threads` threads. The result is exact to the cent
+    // and identical for any thread count.
+    double getNetSalariesParallel(unsigned threads)
+    {
+      const std::vector<std::shared_ptr<Employee>>& employees = employees_;
+      return sumCentsInParallel(employees.size(), threads,
+          [&employees](std::size_t begin, std::size_t end) {
+            std::int64_t cents = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+              cents += toCents(employees[i]->getSalary());
+            }
+            return cents;
+          });
+    }
+
   private:
     std::vector<std::shared_ptr<Employee>> employees_;
 };
 
+// Maps each distinct string to a small integer so that repeated names and
+// roles are stored only once.
+class StringTable
+{
+  public:
+    std::uint32_t intern(const std::string& value)
+    {
+      auto match = ids_.find(value);
+      if (match != ids_.end()) {
+        return match->second;
+      }
+
+      std::uint32_t id = static_cast<std::uint32_t>(values_.size());
+      values_.push_back(value);
+      ids_.emplace(value, id);
+      return id;
+    }
+
+    // Returns the id of a value, or size() if it was never interned.
+    std::uint32_t find(const std::string& value) const
+    {
+      auto match = ids_.find(value);
+      return match == ids_.end() ? size() : match->second;
+    }
+
+    const std::string& lookup(std::uint32_t id) const
+    {
+      return values_[id];
+    }
+
+    std::uint32_t size(void) const
+    {
+      return static_cast<std::uint32_t>(values_.size());
+    }
+
+  private:
+    std::vector<std::string> values_;
+    std::unordered_map<std::string, std::uint32_t> ids_;
+};
+
+// Sums a column of salaries, optionally only where roles[i] == role. Several
+// accumulators keep the additions independent of each other.
+static float sumSalariesScalar(const float* salaries, std::size_t count)
+{
+  float net[4] = {0, 0, 0, 0};
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    net[0] += salaries[i];
+    net[1] += salaries[i + 1];
+    net[2] += salaries[i + 2];
+    net[3] += salaries[i + 3];
+  }
+  for (; i < count; ++i) {
+    net[0] += salaries[i];
+  }
+
+  return (net[0] + net[1]) + (net[2] + net[3]);
+}
+
+static float sumSalariesScalar(const float* salaries,
+                               const std::uint32_t* roles, std::uint32_t role,
+                               std::size_t count)
+{
+  float net = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    net += roles[i] == role ? salaries[i] : 0.0f;
+  }
+
+  return net;
+}
+
+#ifdef COMPOSITE_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static float horizontalSum(__m256 values)
+{
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(values),
+                          _mm256_extractf128_ps(values, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2")))
+static float sumSalariesAvx2(const float* salaries, std::size_t count)
+{
+  __m256 net0 = _mm256_setzero_ps();
+  __m256 net1 = _mm256_setzero_ps();
+  __m256 net2 = _mm256_setzero_ps();
+  __m256 net3 = _mm256_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    net0 = _mm256_add_ps(net0, _mm256_loadu_ps(salaries + i));
+    net1 = _mm256_add_ps(net1, _mm256_loadu_ps(salaries + i + 8));
+    net2 = _mm256_add_ps(net2, _mm256_loadu_ps(salaries + i + 16));
+    net3 = _mm256_add_ps(net3, _mm256_loadu_ps(salaries + i + 24));
+  }
+  for (; i + 8 <= count; i += 8) {
+    net0 = _mm256_add_ps(net0, _mm256_loadu_ps(salaries + i));
+  }
+
+  float net = horizontalSum(_mm256_add_ps(_mm256_add_ps(net0, net1),
+                                          _mm256_add_ps(net2, net3)));
+  return net + sumSalariesScalar(salaries + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static float sumSalariesAvx2(const float* salaries,
+                             const std::uint32_t* roles, std::uint32_t role,
+                             std::size_t count)
+{
+  const __m256i wanted = _mm256_set1_epi32(static_cast<int>(role));
+  __m256 net0 = _mm256_setzero_ps();
+  __m256 net1 = _mm256_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i roles0 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(roles + i));
+    __m256i roles1 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(roles + i + 8));
+    __m256 mask0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(roles0, wanted));
+    __m256 mask1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(roles1, wanted));
+    net0 = _mm256_add_ps(net0,
+                         _mm256_and_ps(mask0, _mm256_loadu_ps(salaries + i)));
+    net1 = _mm256_add_ps(net1,
+                         _mm256_and_ps(mask1,
+                                       _mm256_loadu_ps(salaries + i + 8)));
+  }
+
+  float net = horizontalSum(_mm256_add_ps(net0, net1));
+  return net + sumSalariesScalar(salaries + i, roles + i, role, count - i);
+}
+
+static bool hasAvx2(void)
+{
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+// An organization that keeps its employees column by column instead of as a
+// list of objects. Employees are still handed over as Employee objects, but
+// their data is copied in, so salary changes must go through the
+// organization.
+class ColumnarOrganization
+{
+  public:
+    std::size_t addEmployee(std::shared_ptr<Employee> employee)
+    {
+      names_.push_back(nameTable_.intern(employee->getName()));
+      roles_.push_back(roleTable_.intern(employee->getRole()));
+      salaries_.push_back(employee->getSalary());
+      return salaries_.size() - 1;
+    }
+
+    std::size_t size(void) const
+    {
+      return salaries_.size();
+    }
+
+    const std::string& getName(std::size_t index) const
+    {
+      return nameTable_.lookup(names_[index]);
+    }
+
+    const std::string& getRole(std::size_t index) const
+    {
+      return roleTable_.lookup(roles_[index]);
+    }
+
+    float getSalary(std::size_t index) const
+    {
+      return salaries_[index];
+    }
+
+    void setSalary(std::size_t index, float salary)
+    {
+      salaries_[index] = salary;
+    }
+
+    float getNetSalaries(void) const
+    {
+#ifdef COMPOSITE_AVX2_DISPATCH
+      if (hasAvx2()) {
+        return sumSalariesAvx2(salaries_.data(), salaries_.size());
+      }
+#endif
+      return sumSalariesScalar(salaries_.data(), salaries_.size());
+    }
+
+    double getNetSalariesParallel(unsigned threads) const
+    {
+      const float* salaries = salaries_.data();
+      return sumCentsInParallel(salaries_.size(), threads,
+          [salaries](std::size_t begin, std::size_t end) {
+            std::int64_t cents = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+              cents += toCents(salaries[i]);
+            }
+            return cents;
+          });
+    }
+
+    float getNetSalaries(const std::string& role) const
+    {
+      std::uint32_t id = roleTable_.find(role);
+      if (id == roleTable_.size()) {
+        return 0;
+      }
+
+#ifdef COMPOSITE_AVX2_DISPATCH
+      if (hasAvx2()) {
+        return sumSalariesAvx2(salaries_.data(), roles_.data(), id,
+                               salaries_.size());
+      }
+#endif
+      return sumSalariesScalar(salaries_.data(), roles_.data(), id,
+                               salaries_.size());
+    }
+
+    // Net salaries of every role, gathered in a single pass.
+    std::map<std::string, float> getNetSalariesByRole(void) const
+    {
+      std::vector<float> net(roleTable_.size(), 0);
+      for (std::size_t i = 0; i < salaries_.size(); ++i) {
+        net[roles_[i]] += salaries_[i];
+      }
+
+      std::map<std::string, float> byRole;
+      for (std::uint32_t id = 0; id < roleTable_.size(); ++id) {
+        byRole[roleTable_.lookup(id)] = net[id];
+      }
+
+      return byRole;
+    }
+
+  private:
+    StringTable nameTable_;
+    StringTable roleTable_;
+    std::vector<std::uint32_t> names_;
+    std::vector<std::uint32_t> roles_;
+    std::vector<float> salaries_;
+};
+
+class Department;
+
+// An employee that belongs to a department. Salary changes are reported to
+// the department so that cached totals stay correct; the department owns the
+// employee, so they can not be made behind its back.
+class Member : public Employee
+{
+  public:
+    Member(std::unique_ptr<Employee> employee, Department* department)
+        : employee_(std::move(employee)), department_(department)
+    {
+    }
+
+    std::string getName(void)
+    {
+      return employee_->getName();
+    }
+
+    void setSalary(float salary);
+
+    float getSalary(void)
+    {
+      return employee_->getSalary();
+    }
+
+    std::string getRole(void)
+    {
+      return employee_->getRole();
+    }
+
+    void leave(void)
+    {
+      department_ = nullptr;
+    }
+
+  private:
+    std::unique_ptr<Employee> employee_;
+    Department* department_;
+};
+
+// A node of a nested organization (e.g. a department made of teams made of
+// employees). Each node caches the net salaries of its whole subtree, in
+// whole cents so that updates never accumulate rounding errors, so querying
+// it is O(1) and a salary change only walks up to the root.
+class Department
+{
+  public:
+    Department(const std::string& name)
+        : name_(name), parent_(nullptr), netCents_(0)
+    {
+    }
+
+    ~Department(void)
+    {
+      for (auto& department : departments_) {
+        department->parent_ = nullptr;
+      }
+      for (auto& member : members_) {
+        member->leave();
+      }
+    }
+
+    const std::string& getName(void) const
+    {
+      return name_;
+    }
+
+    // A department can only belong to a single parent, and not to one of its
+    // own subdepartments.
+    void addDepartment(std::shared_ptr<Department> department)
+    {
+      if (department->parent_) {
+        throw std::invalid_argument("The department already has a parent.");
+      }
+      for (Department* node = this; node; node = node->parent_) {
+        if (node == department.get()) {
+          throw std::invalid_argument("The departments would form a cycle.");
+        }
+      }
+
+      department->parent_ = this;
+      departments_.push_back(department);
+      adjustNetSalaries(department->netCents_);
+    }
+
+    // Takes the employee over and returns it as seen by this department, so
+    // that every salary change keeps the cached totals up to date.
+    std::shared_ptr<Employee> addEmployee(std::unique_ptr<Employee> employee)
+    {
+      std::int64_t cents = toCents(employee->getSalary());
+      std::shared_ptr<Member> member =
+          std::make_shared<Member>(std::move(employee), this);
+      members_.push_back(member);
+      adjustNetSalaries(cents);
+      return member;
+    }
+
+    double getNetSalaries(void) const
+    {
+      return netCents_ / 100.0;
+    }
+
+    // Walks the whole subtree instead of using the cached totals.
+    double recomputeNetSalaries(void) const
+    {
+      return recomputeNetCents() / 100.0;
+    }
+
+  private:
+    friend class Member;
+
+    std::int64_t recomputeNetCents(void) const
+    {
+      std::int64_t cents = 0;
+      for (const auto& member : members_) {
+        cents += toCents(member->getSalary());
+      }
+      for (const auto& department : departments_) {
+        cents += department->recomputeNetCents();
+      }
+
+      return cents;
+    }
+
+    void adjustNetSalaries(std::int64_t deltaCents)
+    {
+      for (Department* node = this; node; node = node->parent_) {
+        node->netCents_ += deltaCents;
+      }
+    }
+
+    std::string name_;
+    Department* parent_;
+    std::int64_t netCents_;
+    std::vector<std::shared_ptr<Department>> departments_;
+    std::vector<std::shared_ptr<Member>> members_;
+};
+
+void Member::setSalary(float salary)
+{
+  std::int64_t deltaCents = toCents(salary) - toCents(employee_->getSalary());
+  employee_->setSalary(salary);
+  if (department_) {
+    department_->adjustNetSalaries(deltaCents);
+  }
+}
+
 int main()
 {
   // Prepare the employees.
@@ -116,5 +584,44 @@ int main()
   // Get the net salaries.
   std::cout << org.getNetSalaries() << std::endl; // Output: 95000
 
+  // Or add them up on two threads.
+  std::cout << org.getNetSalariesParallel(2) << std::endl; // Output: 95000
+
+  // The same employees stored column by column.
+  ColumnarOrganization columnar;
+  columnar.addEmployee(jane);
+  columnar.addEmployee(john);
+
+  std::cout << columnar.getNetSalaries() << std::endl; // Output: 95000
+  std::cout << columnar.getNetSalaries("Designer") << std::endl;
+  // Output: 45000
+
+  // A nested organization: the engineering department has two teams.
+  std::shared_ptr<Department> engineering =
+      std::make_shared<Department>("Engineering");
+  std::shared_ptr<Department> frontend =
+      std::make_shared<Department>("Frontend");
+  std::shared_ptr<Department> backend =
+      std::make_shared<Department>("Backend");
+  engineering->addDepartment(frontend);
+  engineering->addDepartment(backend);
+
+  std::shared_ptr<Employee> alice =
+      frontend->addEmployee(std::make_unique<Designer>("Alice", 40000));
+  backend->addEmployee(std::make_unique<Developer>("Bob", 60000));
+  std::cout << engineering->getNetSalaries() << std::endl; // Output: 100000
+
+  // Only the frontend team and the engineering department are updated.
+  alice->setSalary(42000);
+  std::cout << engineering->getNetSalaries() << std::endl; // Output: 102000
+
+  // A department belongs to a single parent.
+  try {
+    backend->addDepartment(frontend);
+  } catch (const std::invalid_argument& error) {
+    std::cout << error.what() << std::endl;
+    // Output: The department already has a parent.
+  }
+
   return 0;
 }
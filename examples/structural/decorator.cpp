@@ -1,12 +1,38 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class Coffee
 {
   public:
+    // Condiments unregister themselves when destroyed, even through a Coffee*.
+    virtual ~Coffee(void) = default;
+
     virtual float getPrice(void) = 0;
-    virtual std::string getDescription(void) = 0;
+
+    // Renders the whole description with a single allocation. Coffees that
+    // have a faster way can still override it.
+    virtual std::string getDescription(void)
+    {
+      std::string description;
+      description.reserve(getDescriptionLength());
+      appendDescription(description);
+      return description;
+    }
+
+    // The exact length of the description.
+    virtual std::size_t getDescriptionLength(void) = 0;
+
+    // Appends the description to `description`, which does not allocate if it
+    // already has room for getDescriptionLength() more characters.
+    virtual void appendDescription(std::string& description) = 0;
 };
 
 class SimpleCoffee : public Coffee
@@ -17,10 +43,18 @@ class SimpleCoffee : public Coffee
       return 3;
     }
 
-    std::string getDescription(void)
+    std::size_t getDescriptionLength(void)
     {
-      return "Simple coffee";
+      return kDescription.size();
     }
+
+    void appendDescription(std::string& description)
+    {
+      description += kDescription;
+    }
+
+  private:
+    static constexpr std::string_view kDescription = "Simple coffee";
 };
 
 class MilkCoffee : public Coffee
@@ -36,12 +70,20 @@ class MilkCoffee : public Coffee
       return coffee_->getPrice() + 0.5;
     }
 
-    std::string getDescription(void)
+    std::size_t getDescriptionLength(void)
     {
-      return coffee_->getDescription() + ", milk";
+      return coffee_->getDescriptionLength() + kDescription.size();
+    }
+
+    void appendDescription(std::string& description)
+    {
+      coffee_->appendDescription(description);
+      description += kDescription;
     }
 
   private:
+    static constexpr std::string_view kDescription = ", milk";
+
     std::shared_ptr<Coffee> coffee_;
 };
 
@@ -58,12 +100,20 @@ class WhipCoffee : public Coffee
       return coffee_->getPrice() + 2;
     }
 
-    std::string getDescription(void)
+    std::size_t getDescriptionLength(void)
     {
-      return coffee_->getDescription() + ", whip";
+      return coffee_->getDescriptionLength() + kDescription.size();
+    }
+
+    void appendDescription(std::string& description)
+    {
+      coffee_->appendDescription(description);
+      description += kDescription;
     }
 
   private:
+    static constexpr std::string_view kDescription = ", whip";
+
     std::shared_ptr<Coffee> coffee_;
 };
 
@@ -80,15 +130,236 @@ class VanillaCoffee : public Coffee
       return coffee_->getPrice() + 1;
     }
 
-    std::string getDescription(void)
+    std::size_t getDescriptionLength(void)
     {
-      return coffee_->getDescription() + ", vanilla";
+      return coffee_->getDescriptionLength() + kDescription.size();
+    }
+
+    void appendDescription(std::string& description)
+    {
+      coffee_->appendDescription(description);
+      description += kDescription;
     }
 
   private:
+    static constexpr std::string_view kDescription = ", vanilla";
+
     std::shared_ptr<Coffee> coffee_;
 };
 
+// Condiments for decorating a coffee at compile time. Each one only knows
+// what it adds to the coffee it decorates.
+struct Milk
+{
+  static constexpr float price = 0.5;
+  static constexpr std::string_view description = "milk";
+};
+
+struct Whip
+{
+  static constexpr float price = 2;
+  static constexpr std::string_view description = "whip";
+};
+
+struct Vanilla
+{
+  static constexpr float price = 1;
+  static constexpr std::string_view description = "vanilla";
+};
+
+// A coffee decorated with a fixed list of condiments, innermost first. The
+// whole stack is a single object and the base is called without a virtual
+// call, so the compiler can fold the price into a constant. It is still a
+// Coffee and can be used wherever the runtime decorators are.
+template <typename Base, typename... Condiments>
+class Decorated final : public Base
+{
+  public:
+    float getPrice(void)
+    {
+      return (Base::getPrice() + ... + Condiments::price);
+    }
+
+    std::size_t getDescriptionLength(void)
+    {
+      return (Base::getDescriptionLength() + ... +
+              (2 + Condiments::description.size()));
+    }
+
+    void appendDescription(std::string& description)
+    {
+      Base::appendDescription(description);
+      ((description += ", ", description += Condiments::description), ...);
+    }
+};
+
+// A coffee that remembers its price and description. Each coffee knows the
+// versioned coffees built on top of it; a change marks the coffee and
+// everything above it as stale, stopping at coffees that already are, so a
+// query is O(1) when nothing below it changed and unrelated coffees are never
+// touched. A stale coffee recomputes its result once, from the coffee below
+// it, which also works when inner coffees are shared between several
+// products. Coffees can be queried and changed from several threads.
+class VersionedCoffee : public Coffee
+{
+  public:
+    VersionedCoffee(void)
+        : cachedPrice_(0), version_(0), stale_(true)
+    {
+    }
+
+    float getPrice(void)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      refresh();
+      return cachedPrice_;
+    }
+
+    std::size_t getDescriptionLength(void)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      refresh();
+      return cachedDescription_.size();
+    }
+
+    void appendDescription(std::string& description)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      refresh();
+      description += cachedDescription_;
+    }
+
+    // Changes whenever the price or the description of this coffee changes.
+    std::uint64_t getVersion(void)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      refresh();
+      return version_;
+    }
+
+  protected:
+    // Tells this coffee and every coffee built on it that their results are
+    // out of date. Called after the change is made.
+    void invalidate(void)
+    {
+      if (stale_.exchange(true)) {
+        // Everything above a stale coffee is stale already.
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(dependentsMutex_);
+      for (VersionedCoffee* dependent : dependents_) {
+        dependent->invalidate();
+      }
+    }
+
+    // Recomputes the price and description, with the cache locked.
+    virtual void update(float& price, std::string& description) = 0;
+
+    // Registers this coffee as built on `coffee`, so that changes to it are
+    // passed on.
+    void dependOn(VersionedCoffee& coffee)
+    {
+      std::lock_guard<std::mutex> lock(coffee.dependentsMutex_);
+      coffee.dependents_.push_back(this);
+    }
+
+    void stopDependingOn(VersionedCoffee& coffee)
+    {
+      std::lock_guard<std::mutex> lock(coffee.dependentsMutex_);
+      coffee.dependents_.erase(std::find(coffee.dependents_.begin(),
+                                         coffee.dependents_.end(), this));
+    }
+
+  private:
+    // Called with the cache locked.
+    void refresh(void)
+    {
+      // Cleared before reading the inner coffees, so that a change made
+      // while recomputing marks this coffee stale again.
+      if (!stale_.exchange(false)) {
+        return;
+      }
+      update(cachedPrice_, cachedDescription_);
+      ++version_;
+    }
+
+    std::mutex mutex_;
+    float cachedPrice_;
+    std::string cachedDescription_;
+    std::uint64_t version_;
+    std::atomic<bool> stale_;
+
+    std::mutex dependentsMutex_;
+    std::vector<VersionedCoffee*> dependents_;
+};
+
+// A base coffee whose price can change, e.g. when the beans get pricier.
+class HouseCoffee : public VersionedCoffee
+{
+  public:
+    HouseCoffee(float price)
+        : price_(price)
+    {
+    }
+
+    void setPrice(float price)
+    {
+      price_.store(price);
+      invalidate();
+    }
+
+  protected:
+    void update(float& price, std::string& description)
+    {
+      price = price_.load();
+      description = "House coffee";
+    }
+
+  private:
+    std::atomic<float> price_;
+};
+
+// A condiment on top of a versioned coffee, which may be shared with other
+// products.
+class VersionedCondiment : public VersionedCoffee
+{
+  public:
+    VersionedCondiment(std::shared_ptr<VersionedCoffee> coffee,
+                       std::string_view name, float price)
+        : coffee_(coffee), name_(name), price_(price)
+    {
+      dependOn(*coffee_);
+    }
+
+    ~VersionedCondiment(void)
+    {
+      stopDependingOn(*coffee_);
+    }
+
+    void setPrice(float price)
+    {
+      price_.store(price);
+      invalidate();
+    }
+
+  protected:
+    void update(float& price, std::string& description)
+    {
+      price = coffee_->getPrice() + price_.load();
+      description.clear();
+      description.reserve(coffee_->getDescriptionLength() + 2 + name_.size());
+      coffee_->appendDescription(description);
+      description += ", ";
+      description += name_;
+    }
+
+  private:
+    std::shared_ptr<VersionedCoffee> coffee_;
+    std::string name_;
+    std::atomic<float> price_;
+};
+
 int main()
 {
   std::shared_ptr<Coffee> simple = std::make_shared<SimpleCoffee>();
@@ -115,5 +386,45 @@ int main()
   std::cout << vanilla->getDescription() << std::endl;
   // Output: Simple coffee, milk, whip, vanilla
 
+  // Descriptions can also be rendered into a reused buffer.
+  std::string buffer;
+  buffer.reserve(vanilla->getDescriptionLength());
+  vanilla->appendDescription(buffer);
+  std::cout << buffer << std::endl;
+  // Output: Simple coffee, milk, whip, vanilla
+
+  // The same coffee, decorated at compile time.
+  Decorated<SimpleCoffee, Milk, Whip, Vanilla> decorated;
+  std::cout << decorated.getPrice() << std::endl;
+  // Output: 6.5
+  std::cout << decorated.getDescription() << std::endl;
+  // Output: Simple coffee, milk, whip, vanilla
+
+  // Two products sharing the same house coffee with milk.
+  std::shared_ptr<HouseCoffee> house = std::make_shared<HouseCoffee>(2);
+  std::shared_ptr<VersionedCoffee> houseMilk =
+      std::make_shared<VersionedCondiment>(house, "milk", 0.5);
+  std::shared_ptr<VersionedCoffee> houseWhip =
+      std::make_shared<VersionedCondiment>(houseMilk, "whip", 2);
+  std::shared_ptr<VersionedCoffee> houseVanilla =
+      std::make_shared<VersionedCondiment>(houseMilk, "vanilla", 1);
+  assert(houseWhip->getPrice() == 4.5);
+  assert(houseVanilla->getPrice() == 3.5);
+  assert(houseWhip->getDescription() == "House coffee, milk, whip");
+
+  // A change in the shared base shows up in both products.
+  std::uint64_t whipVersion = houseWhip->getVersion();
+  house->setPrice(3);
+  assert(houseWhip->getPrice() == 5.5);
+  assert(houseVanilla->getPrice() == 4.5);
+  assert(houseWhip->getVersion() != whipVersion);
+
+  // Unrelated coffees keep their cached results.
+  std::shared_ptr<HouseCoffee> other = std::make_shared<HouseCoffee>(1);
+  whipVersion = houseWhip->getVersion();
+  other->setPrice(1.5);
+  assert(houseWhip->getVersion() == whipVersion);
+  assert(houseWhip->getDescription() == "House coffee, milk, whip");
+
   return 0;
 }
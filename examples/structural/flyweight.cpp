@@ -1,6 +1,15 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 struct Tea
 {
@@ -58,6 +67,674 @@ class TeaShop
     std::unordered_map<int, std::shared_ptr<Tea>> orders_;
 };
 
+// A tea maker that can be shared by many threads. Preferences are spread over
+// independently locked shards, so lookups of different preferences rarely
+// wait on each other and lookups of the same preference only share a read
+// lock. Each lookup hashes the preference exactly once: the hash picks the
+// shard and then the slot, and is stored next to the key so that the table
+// can grow without hashing the keys again.
+class ConcurrentTeaMaker
+{
+  public:
+    ConcurrentTeaMaker(std::size_t shards = 16)
+        : shards_(roundUpToPowerOfTwo(shards))
+    {
+    }
+
+    std::shared_ptr<Tea> make(std::string_view preference)
+    {
+      const std::size_t hash = std::hash<std::string_view>()(preference);
+      Shard& shard = shards_[(hash >> kShardShift) & (shards_.size() - 1)];
+
+      {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const Slot* slot = shard.find(hash, preference);
+        if (slot) {
+          return slot->tea;
+        }
+      }
+
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      // Another thread may have made it while we were waiting for the lock.
+      const Slot* slot = shard.find(hash, preference);
+      if (slot) {
+        return slot->tea;
+      }
+
+      return shard.insert(hash, preference, std::make_shared<Tea>());
+    }
+
+    int getPreferenceCount(void)
+    {
+      std::size_t count = 0;
+      for (auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        count += shard.count;
+      }
+
+      return static_cast<int>(count);
+    }
+
+  private:
+    // The top bits of the hash choose the shard, the bottom bits the slot.
+    static const int kShardShift = sizeof(std::size_t) * 8 - 16;
+
+    struct Slot
+    {
+      std::size_t hash;
+      std::string preference;
+      std::shared_ptr<Tea> tea;
+    };
+
+    // Open addressing with linear probing; a slot is free when it has no tea.
+    struct alignas(64) Shard
+    {
+      Shard(void)
+          : slots(16), count(0)
+      {
+      }
+
+      const Slot* find(std::size_t hash, std::string_view preference) const
+      {
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t i = hash & mask; slots[i].tea; i = (i + 1) & mask) {
+          if (slots[i].hash == hash && slots[i].preference == preference) {
+            return &slots[i];
+          }
+        }
+
+        return nullptr;
+      }
+
+      std::shared_ptr<Tea> insert(std::size_t hash,
+                                  std::string_view preference,
+                                  std::shared_ptr<Tea> tea)
+      {
+        if ((count + 1) * 2 > slots.size()) {
+          grow();
+        }
+
+        Slot& slot = freeSlot(hash);
+        slot.hash = hash;
+        slot.preference.assign(preference.data(), preference.size());
+        slot.tea = std::move(tea);
+        ++count;
+        return slot.tea;
+      }
+
+      Slot& freeSlot(std::size_t hash)
+      {
+        const std::size_t mask = slots.size() - 1;
+        std::size_t i = hash & mask;
+        while (slots[i].tea) {
+          i = (i + 1) & mask;
+        }
+
+        return slots[i];
+      }
+
+      void grow(void)
+      {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        for (auto& slot : old) {
+          if (slot.tea) {
+            freeSlot(slot.hash) = std::move(slot);
+          }
+        }
+      }
+
+      mutable std::shared_mutex mutex;
+      std::vector<Slot> slots;
+      std::size_t count;
+    };
+
+    static std::size_t roundUpToPowerOfTwo(std::size_t value)
+    {
+      std::size_t power = 1;
+      while (power < value) {
+        power *= 2;
+      }
+
+      return power;
+    }
+
+    std::vector<Shard> shards_;
+};
+
+// How a BoundedTeaMaker makes room for a new preference once it is full.
+enum class EvictionPolicy
+{
+  // Throw away the preference that was asked for the longest time ago.
+  LeastRecentlyUsed,
+  // Approximate LRU: sweep a clock hand that gives recently used preferences
+  // a second chance.
+  Clock,
+  // Keep only weak references so that a tea goes away as soon as no order
+  // holds it, and prefer forgetting such preferences when full (falling back
+  // to CLOCK when every tea is still being served).
+  Unreferenced
+};
+
+struct TeaMakerStats
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t evictions;
+  // Approximate memory held by the maker: its entries, their keys, the lookup
+  // index and, unless the policy is Unreferenced, the teas themselves.
+  std::size_t residentBytes;
+};
+
+// A tea maker that never remembers more than `capacity` preferences.
+class BoundedTeaMaker
+{
+  public:
+    BoundedTeaMaker(std::size_t capacity, EvictionPolicy policy)
+        : capacity_(capacity ? capacity : 1), policy_(policy), hand_(0),
+          head_(kNone), tail_(kNone), hits_(0), misses_(0), evictions_(0)
+    {
+      // Entries never move, so the index can refer to their keys in place.
+      entries_.reserve(capacity_);
+      index_.reserve(capacity_);
+    }
+
+    std::shared_ptr<Tea> make(std::string_view preference)
+    {
+      auto match = index_.find(preference);
+      if (match != index_.end()) {
+        Entry& entry = entries_[match->second];
+        std::shared_ptr<Tea> tea = entry.tea ? entry.tea : entry.weak.lock();
+        touch(match->second);
+        if (tea) {
+          ++hits_;
+          return tea;
+        }
+
+        // Every order of this tea has been served, so it has to be made again.
+        ++misses_;
+        return store(entry, std::make_shared<Tea>());
+      }
+
+      ++misses_;
+      std::size_t index = entries_.size();
+      if (index < capacity_) {
+        entries_.emplace_back();
+      } else {
+        index = evict();
+      }
+
+      Entry& entry = entries_[index];
+      entry.preference.assign(preference.data(), preference.size());
+      index_.emplace(entry.preference, index);
+      link(index);
+      return store(entry, std::make_shared<Tea>());
+    }
+
+    int getPreferenceCount(void)
+    {
+      return static_cast<int>(index_.size());
+    }
+
+    TeaMakerStats getStats(void) const
+    {
+      TeaMakerStats stats;
+      stats.hits = hits_;
+      stats.misses = misses_;
+      stats.evictions = evictions_;
+      stats.residentBytes = sizeof(*this) +
+          entries_.capacity() * sizeof(Entry) +
+          index_.bucket_count() * sizeof(void*);
+      for (const auto& entry : entries_) {
+        if (entry.preference.capacity() > std::string().capacity()) {
+          stats.residentBytes += entry.preference.capacity() + 1;
+        }
+        if (entry.tea) {
+          stats.residentBytes += kTeaBytes;
+        }
+      }
+      stats.residentBytes += index_.size() * kIndexNodeBytes;
+
+      return stats;
+    }
+
+  private:
+    static constexpr std::size_t kNone = static_cast<std::size_t>(-1);
+    static constexpr std::size_t kUnreferencedScan = 16;
+    // A make_shared<Tea>() block: two reference counts, a vtable pointer and
+    // the tea itself.
+    static constexpr std::size_t kTeaBytes =
+        2 * sizeof(int) + 2 * sizeof(void*);
+    static constexpr std::size_t kIndexNodeBytes =
+        sizeof(void*) + sizeof(std::string_view) + 2 * sizeof(std::size_t);
+
+    struct Entry
+    {
+      Entry(void)
+          : referenced(false), previous(kNone), next(kNone)
+      {
+      }
+
+      std::string preference;
+      std::shared_ptr<Tea> tea;
+      std::weak_ptr<Tea> weak;
+      bool referenced;
+      std::size_t previous;
+      std::size_t next;
+    };
+
+    std::shared_ptr<Tea> store(Entry& entry, std::shared_ptr<Tea> tea)
+    {
+      if (policy_ == EvictionPolicy::Unreferenced) {
+        entry.weak = tea;
+      } else {
+        entry.tea = tea;
+      }
+
+      return tea;
+    }
+
+    void touch(std::size_t index)
+    {
+      if (policy_ == EvictionPolicy::LeastRecentlyUsed) {
+        unlink(index);
+        link(index);
+      } else {
+        entries_[index].referenced = true;
+      }
+    }
+
+    // Puts an entry at the most recently used end of the LRU list.
+    void link(std::size_t index)
+    {
+      if (policy_ != EvictionPolicy::LeastRecentlyUsed) {
+        return;
+      }
+
+      Entry& entry = entries_[index];
+      entry.previous = kNone;
+      entry.next = head_;
+      if (head_ != kNone) {
+        entries_[head_].previous = index;
+      }
+      head_ = index;
+      if (tail_ == kNone) {
+        tail_ = index;
+      }
+    }
+
+    void unlink(std::size_t index)
+    {
+      Entry& entry = entries_[index];
+      if (entry.previous != kNone) {
+        entries_[entry.previous].next = entry.next;
+      } else {
+        head_ = entry.next;
+      }
+      if (entry.next != kNone) {
+        entries_[entry.next].previous = entry.previous;
+      } else {
+        tail_ = entry.previous;
+      }
+    }
+
+    // Frees an entry according to the policy and returns its index.
+    std::size_t evict(void)
+    {
+      std::size_t victim = kNone;
+      if (policy_ == EvictionPolicy::LeastRecentlyUsed) {
+        victim = tail_;
+        unlink(victim);
+      } else {
+        if (policy_ == EvictionPolicy::Unreferenced) {
+          victim = findUnreferenced();
+        }
+        if (victim == kNone) {
+          victim = sweepClock();
+        }
+      }
+
+      Entry& entry = entries_[victim];
+      index_.erase(entry.preference);
+      entry.tea.reset();
+      entry.weak.reset();
+      entry.referenced = false;
+      ++evictions_;
+      return victim;
+    }
+
+    // Looks a few entries ahead of the clock hand for a tea nobody holds. The
+    // scan is bounded so that eviction stays cheap when every tea is in use.
+    std::size_t findUnreferenced(void)
+    {
+      std::size_t limit = std::min(entries_.size(), kUnreferencedScan);
+      for (std::size_t i = 0; i < limit; ++i) {
+        std::size_t index = (hand_ + i) % entries_.size();
+        if (entries_[index].weak.expired()) {
+          hand_ = (index + 1) % entries_.size();
+          return index;
+        }
+      }
+
+      return kNone;
+    }
+
+    std::size_t sweepClock(void)
+    {
+      while (entries_[hand_].referenced) {
+        entries_[hand_].referenced = false;
+        hand_ = (hand_ + 1) % entries_.size();
+      }
+
+      std::size_t victim = hand_;
+      hand_ = (hand_ + 1) % entries_.size();
+      return victim;
+    }
+
+    std::size_t capacity_;
+    EvictionPolicy policy_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string_view, std::size_t> index_;
+    std::size_t hand_;
+    std::size_t head_;
+    std::size_t tail_;
+    std::uint64_t hits_;
+    std::uint64_t misses_;
+    std::uint64_t evictions_;
+};
+
+// Hands out memory for strings from large blocks. Nothing is ever freed on
+// its own and nothing ever moves, so views into the arena stay valid for as
+// long as the arena lives.
+class StringArena
+{
+  public:
+    StringArena(std::size_t blockSize = 64 * 1024)
+        : blockSize_(blockSize), next_(nullptr), left_(0)
+    {
+    }
+
+    std::string_view store(std::string_view value)
+    {
+      if (value.size() > left_) {
+        std::size_t size = std::max(blockSize_, value.size());
+        blocks_.emplace_back(new char[size]);
+        next_ = blocks_.back().get();
+        left_ = size;
+      }
+
+      char* copy = next_;
+      std::copy(value.begin(), value.end(), copy);
+      next_ += value.size();
+      left_ -= value.size();
+      return std::string_view(copy, value.size());
+    }
+
+    std::size_t getBlockCount(void) const
+    {
+      return blocks_.size();
+    }
+
+  private:
+    std::size_t blockSize_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* next_;
+    std::size_t left_;
+};
+
+// Gives every distinct preference a small, stable integer id. The text of
+// each preference is stored once in an arena, and looking up a known
+// preference allocates nothing.
+class PreferenceInterner
+{
+  public:
+    typedef std::uint32_t id_t;
+
+    PreferenceInterner(void)
+        : slots_(16, kEmpty)
+    {
+    }
+
+    id_t intern(std::string_view preference)
+    {
+      const std::size_t hash = std::hash<std::string_view>()(preference);
+      const std::size_t mask = slots_.size() - 1;
+      std::size_t i = hash & mask;
+      for (; slots_[i] != kEmpty; i = (i + 1) & mask) {
+        const Entry& entry = entries_[slots_[i]];
+        if (entry.hash == hash && entry.preference == preference) {
+          return slots_[i];
+        }
+      }
+
+      id_t id = static_cast<id_t>(entries_.size());
+      entries_.push_back(Entry{hash, arena_.store(preference)});
+      slots_[i] = id;
+      if (entries_.size() * 2 > slots_.size()) {
+        grow();
+      }
+
+      return id;
+    }
+
+    std::string_view lookup(id_t id) const
+    {
+      return entries_[id].preference;
+    }
+
+    std::size_t size(void) const
+    {
+      return entries_.size();
+    }
+
+  private:
+    static constexpr id_t kEmpty = static_cast<id_t>(-1);
+
+    struct Entry
+    {
+      std::size_t hash;
+      std::string_view preference;
+    };
+
+    void grow(void)
+    {
+      std::vector<id_t> slots(slots_.size() * 2, kEmpty);
+      const std::size_t mask = slots.size() - 1;
+      for (id_t id = 0; id < entries_.size(); ++id) {
+        std::size_t i = entries_[id].hash & mask;
+        while (slots[i] != kEmpty) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = id;
+      }
+      slots_.swap(slots);
+    }
+
+    StringArena arena_;
+    std::vector<Entry> entries_;
+    std::vector<id_t> slots_;
+};
+
+// A tea maker that knows preferences by their interned id, so the tea for a
+// preference is found by indexing instead of hashing a string.
+class InternedTeaMaker
+{
+  public:
+    typedef PreferenceInterner::id_t preference_t;
+
+    preference_t intern(std::string_view preference)
+    {
+      preference_t id = interner_.intern(preference);
+      if (id == availableTea_.size()) {
+        availableTea_.push_back(std::make_shared<Tea>());
+      }
+
+      return id;
+    }
+
+    std::shared_ptr<Tea> make(preference_t preference)
+    {
+      return availableTea_[preference];
+    }
+
+    std::shared_ptr<Tea> make(std::string_view preference)
+    {
+      return make(intern(preference));
+    }
+
+    std::string_view getPreference(preference_t preference) const
+    {
+      return interner_.lookup(preference);
+    }
+
+    int getPreferenceCount(void)
+    {
+      return static_cast<int>(availableTea_.size());
+    }
+
+  private:
+    PreferenceInterner interner_;
+    std::vector<std::shared_ptr<Tea>> availableTea_;
+};
+
+// A tea shop that remembers each order as a preference id, in a flat table
+// of orders that only allocates when it doubles. Once a preference has been
+// seen, taking an order allocates nothing most of the time.
+class InternedTeaShop
+{
+  public:
+    InternedTeaShop(std::shared_ptr<InternedTeaMaker> maker)
+        : maker_(maker), orders_(16), orderCount_(0)
+    {
+    }
+
+    void takeOrder(std::string_view preference, int table)
+    {
+      InternedTeaMaker::preference_t id = maker_->intern(preference);
+      Order& order = findOrder(table);
+      if (order.preference == kNoOrder) {
+        order.table = table;
+        ++orderCount_;
+      }
+      order.preference = id;
+      if (orderCount_ * 2 > orders_.size()) {
+        grow();
+      }
+    }
+
+    void serve(void)
+    {
+      for (const auto& order : orders_) {
+        if (order.preference != kNoOrder) {
+          std::cout << "Serving tea to table " << order.table << std::endl;
+        }
+      }
+    }
+
+    int getPreferenceCount(void)
+    {
+      return maker_->getPreferenceCount();
+    }
+
+  private:
+    static constexpr InternedTeaMaker::preference_t kNoOrder =
+        static_cast<InternedTeaMaker::preference_t>(-1);
+
+    struct Order
+    {
+      Order(void)
+          : table(0), preference(kNoOrder)
+      {
+      }
+
+      int table;
+      InternedTeaMaker::preference_t preference;
+    };
+
+    // Open addressing with linear probing over a power of two of slots.
+    Order& findOrder(int table)
+    {
+      const std::size_t mask = orders_.size() - 1;
+      std::size_t i = hashTable(table) & mask;
+      while (orders_[i].preference != kNoOrder && orders_[i].table != table) {
+        i = (i + 1) & mask;
+      }
+
+      return orders_[i];
+    }
+
+    static std::size_t hashTable(int table)
+    {
+      std::uint64_t bits = static_cast<std::uint32_t>(table);
+      return static_cast<std::size_t>((bits * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    void grow(void)
+    {
+      std::vector<Order> old(orders_.size() * 2);
+      old.swap(orders_);
+      for (const auto& order : old) {
+        if (order.preference != kNoOrder) {
+          findOrder(order.table) = order;
+        }
+      }
+    }
+
+    std::shared_ptr<InternedTeaMaker> maker_;
+    std::vector<Order> orders_;
+    std::size_t orderCount_;
+};
+
+// A tea shop for small, dense table numbers. Orders live in a vector indexed
+// by table and a bitmap tells which tables have ordered, so taking an order
+// is a plain store and serving walks the tables in ascending order without
+// touching any reference counts.
+class DenseTeaShop
+{
+  public:
+    DenseTeaShop(std::shared_ptr<TeaMaker> maker)
+        : maker_(maker)
+    {
+    }
+
+    // Tables are numbered from 0.
+    void takeOrder(const std::string& preference, int table)
+    {
+      if (table < 0) {
+        throw std::out_of_range("Tables are numbered from 0.");
+      }
+
+      std::size_t index = static_cast<std::size_t>(table);
+      if (index >= orders_.size()) {
+        orders_.resize(index + 1);
+        ordered_.resize(index / 64 + 1, 0);
+      }
+
+      orders_[index] = maker_->make(preference);
+      ordered_[index / 64] |= std::uint64_t(1) << (index % 64);
+    }
+
+    void serve(void)
+    {
+      for (std::size_t word = 0; word < ordered_.size(); ++word) {
+        for (std::uint64_t bits = ordered_[word]; bits; bits &= bits - 1) {
+          std::size_t table = word * 64 + __builtin_ctzll(bits);
+          std::cout << "Serving tea to table " << table << std::endl;
+        }
+      }
+    }
+
+    int getPreferenceCount(void)
+    {
+      return maker_->getPreferenceCount();
+    }
+
+  private:
+    std::shared_ptr<TeaMaker> maker_;
+    std::vector<std::shared_ptr<Tea>> orders_;
+    std::vector<std::uint64_t> ordered_;
+};
+
 int main()
 {
   std::shared_ptr<TeaMaker> maker = std::make_shared<TeaMaker>();
@@ -89,5 +766,41 @@ int main()
   // Serving tea to table 1
   // Serving tea to table 2
 
+  // A tea maker that many shops can use at the same time.
+  ConcurrentTeaMaker sharedMaker;
+  std::shared_ptr<Tea> tea = sharedMaker.make("half sugar");
+  std::string_view preference = "half sugar";
+  std::cout << (sharedMaker.make(preference) == tea) << std::endl; // Output: 1
+  std::cout << sharedMaker.getPreferenceCount() << std::endl; // Output: 1
+
+  // A tea maker that only remembers the two most recent preferences.
+  BoundedTeaMaker boundedMaker(2, EvictionPolicy::LeastRecentlyUsed);
+  boundedMaker.make("half sugar");
+  boundedMaker.make("with milk");
+  boundedMaker.make("half sugar");
+  boundedMaker.make("with boba"); // Forgets "with milk".
+  std::cout << boundedMaker.getPreferenceCount() << std::endl; // Output: 2
+  std::cout << boundedMaker.getStats().evictions << std::endl; // Output: 1
+
+  // A tea shop that keys its orders on interned preferences.
+  std::shared_ptr<InternedTeaMaker> internedMaker =
+      std::make_shared<InternedTeaMaker>();
+  InternedTeaShop internedShop(internedMaker);
+  internedShop.takeOrder("half sugar", 1);
+  internedShop.takeOrder("with milk", 2);
+  internedShop.takeOrder("half sugar", 4);
+  std::cout << internedShop.getPreferenceCount() << std::endl; // Output: 2
+  std::cout << internedMaker->getPreference(1) << std::endl;
+  // Output: with milk
+
+  // A tea shop that serves its tables in order.
+  DenseTeaShop denseShop(maker);
+  denseShop.takeOrder("half sugar", 5);
+  denseShop.takeOrder("with milk", 2);
+  denseShop.serve();
+  // Output:
+  // Serving tea to table 2
+  // Serving tea to table 5
+
   return 0;
 }
@@ -1,6 +1,20 @@
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 class Door
 {
@@ -23,17 +37,238 @@ class LabDoor : public Door
     }
 };
 
+// A door that is only built the first time it is used, for doors that are
+// expensive to set up and may never be opened. Callers that arrive while it is
+// being built wait for that one construction to finish. warmUp() starts
+// building it in the background so that the first opening does not have to
+// wait at all.
+class LazyDoor : public Door
+{
+  public:
+    typedef std::function<std::shared_ptr<Door>(void)> factory_t;
+
+    LazyDoor(factory_t factory)
+        : factory_(factory), ready_(nullptr), warming_(false)
+    {
+    }
+
+    LazyDoor(const LazyDoor&) = delete;
+    LazyDoor& operator=(const LazyDoor&) = delete;
+
+    ~LazyDoor(void)
+    {
+      if (warmer_.joinable()) {
+        warmer_.join();
+      }
+    }
+
+    void open(void)
+    {
+      getDoor().open();
+    }
+
+    void close(void)
+    {
+      getDoor().close();
+    }
+
+    // Builds the door on a worker thread unless it is already built or being
+    // built. If that fails, the next use, or warm-up, tries again.
+    void warmUp(void)
+    {
+      std::lock_guard<std::mutex> lock(warmerMutex_);
+      if (isReady() || warming_.load(std::memory_order_acquire)) {
+        return;
+      }
+      if (warmer_.joinable()) {
+        // An earlier warm-up that failed; it has already finished.
+        warmer_.join();
+      }
+      warming_.store(true, std::memory_order_relaxed);
+      warmer_ = std::thread([this]() {
+        try {
+          getDoor();
+        } catch (...) {
+        }
+        warming_.store(false, std::memory_order_release);
+      });
+    }
+
+    bool isReady(void) const
+    {
+      return ready_.load(std::memory_order_acquire) != nullptr;
+    }
+
+    // The real door, built on first use. Throws if it can not be built, in
+    // which case the next call tries again.
+    Door& getDoor(void)
+    {
+      Door* door = ready_.load(std::memory_order_acquire);
+      if (door) {
+        return *door;
+      }
+
+      std::lock_guard<std::mutex> lock(buildMutex_);
+      door = ready_.load(std::memory_order_relaxed);
+      if (!door) {
+        std::shared_ptr<Door> built = factory_();
+        if (!built) {
+          throw std::runtime_error("The door could not be built.");
+        }
+        door_ = built;
+        door = door_.get();
+        ready_.store(door, std::memory_order_release);
+      }
+      return *door;
+    }
+
+  private:
+    factory_t factory_;
+    std::mutex buildMutex_;
+    std::shared_ptr<Door> door_;
+    std::atomic<Door*> ready_;
+
+    std::mutex warmerMutex_;
+    std::thread warmer_;
+    std::atomic<bool> warming_;
+};
+
+// A token bucket that refills at `rate` tokens per second and holds up to
+// `burst` of them. It is kept as the time at which it will be full again, so
+// taking a token is a single compare-and-swap and never blocks. The rate is
+// kept in whole nanoseconds per token, so it can not exceed 1e9.
+class RateLimiter
+{
+  public:
+    typedef std::chrono::steady_clock clock_t;
+
+    RateLimiter(double rate, double burst)
+        : interval_(toInterval(rate)),
+          capacity_(static_cast<std::int64_t>(1e9 / rate * burst)), full_(0)
+    {
+    }
+
+    bool tryTake(clock_t::time_point time = clock_t::now())
+    {
+      std::int64_t now = toNanoseconds(time);
+      std::int64_t full = full_.load(std::memory_order_relaxed);
+      while (true) {
+        std::int64_t next = std::max(full, now) + interval_;
+        if (next - now > capacity_) {
+          return false;
+        }
+        if (full_.compare_exchange_weak(full, next,
+                                        std::memory_order_relaxed)) {
+          return true;
+        }
+      }
+    }
+
+    // Whether every token is back, i.e. the bucket is as good as new.
+    bool isFull(clock_t::time_point time) const
+    {
+      return full_.load(std::memory_order_relaxed) <= toNanoseconds(time);
+    }
+
+  private:
+    static std::int64_t toInterval(double rate)
+    {
+      if (!(rate > 0 && rate <= 1e9)) {
+        throw std::invalid_argument(
+            "The rate must be above 0 and at most 1e9 per second.");
+      }
+      return static_cast<std::int64_t>(1e9 / rate);
+    }
+
+    static std::int64_t toNanoseconds(clock_t::time_point time)
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          time.time_since_epoch()).count();
+    }
+
+    std::int64_t interval_;
+    std::int64_t capacity_;
+    std::atomic<std::int64_t> full_;
+};
+
 class SecuredDoor
 {
   public:
-    SecuredDoor(std::shared_ptr<Door> door)
-        : door_(door)
+    typedef std::chrono::steady_clock clock_t;
+
+    // Every caller may try to log in or open the door `rate` times per
+    // second, with bursts of up to `burst`, and a session lasts for
+    // `sessionLifetime`. Opening the door with the password is limited the
+    // same way, for all callers together.
+    SecuredDoor(std::shared_ptr<Door> door, double rate = 100,
+                double burst = 10,
+                std::chrono::seconds sessionLifetime = std::chrono::hours(1))
+        : door_(door), rate_(rate), burst_(burst),
+          sessionLifetime_(sessionLifetime), passwordLimiter_(rate, burst),
+          purgeAt_(kFirstPurge)
     {
     }
 
+    // Checks the password once and returns a token that opens the door
+    // without it, or 0 if the password is wrong or the caller has tried too
+    // often lately. Every attempt counts against the caller's limit, so that
+    // passwords can not be guessed faster than the door can be opened.
+    std::uint64_t login(const std::string& caller, const std::string& password)
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      if (sessions_.size() >= purgeAt_ || limiters_.size() >= purgeAt_) {
+        purge();
+      }
+      std::unique_ptr<RateLimiter>& limiter = limiters_[caller];
+      if (!limiter) {
+        limiter.reset(new RateLimiter(rate_, burst_));
+      }
+      if (!limiter->tryTake() || !authenticate(password)) {
+        return 0;
+      }
+
+      // Tokens come straight from the system's entropy source, since a
+      // seeded generator gives its state away after enough of them.
+      std::uint64_t token = 0;
+      while (token == 0 || sessions_.count(token)) {
+        token = static_cast<std::uint64_t>(random_()) << 32 | random_();
+      }
+      sessions_.emplace(token, Session{limiter.get(),
+                                       clock_t::now() + sessionLifetime_});
+      return token;
+    }
+
+    void logout(std::uint64_t token)
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      sessions_.erase(token);
+    }
+
+    // Opens the door for a session, unless the token is unknown or expired or
+    // its caller has opened it too often lately. Any number of threads can
+    // open doors at once; callers over their limit are turned away without
+    // waiting.
+    bool open(std::uint64_t token)
+    {
+      switch (checkSession(token)) {
+        case Access::Denied:
+          std::cout << "No way, Jose!" << std::endl;
+          return false;
+        case Access::Limited:
+          std::cout << "Not so fast, Jose!" << std::endl;
+          return false;
+        case Access::Granted:
+          break;
+      }
+      door_->open();
+      return true;
+    }
+
     void open(const std::string& password)
     {
-      if (authenticate(password)) {
+      if (!passwordLimiter_.tryTake()) {
+        std::cout << "Not so fast, Jose!" << std::endl;
+      } else if (authenticate(password)) {
         door_->open();
       } else {
         std::cout << "No way, Jose!" << std::endl;
@@ -46,12 +281,83 @@ class SecuredDoor
     }
 
   private:
+    struct Session
+    {
+      RateLimiter* limiter;
+      clock_t::time_point expiry;
+    };
+
+    enum class Access
+    {
+      Denied,
+      Limited,
+      Granted
+    };
+
+    static constexpr std::size_t kFirstPurge = 1024;
+
     bool authenticate(const std::string& password)
     {
       return password == "Bond007";
     }
 
+    // The limiter is used under the lock, so that a purge can not free it
+    // meanwhile. Reading the clock can cost as much as the rest of the
+    // checks, so it is read once, and only for known sessions.
+    Access checkSession(std::uint64_t token)
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      std::unordered_map<std::uint64_t, Session>::const_iterator session =
+          sessions_.find(token);
+      if (session == sessions_.end()) {
+        return Access::Denied;
+      }
+      clock_t::time_point now = clock_t::now();
+      if (session->second.expiry <= now) {
+        return Access::Denied;
+      }
+      return session->second.limiter->tryTake(now) ? Access::Granted
+                                                   : Access::Limited;
+    }
+
+    // Forgets expired sessions, and the limiters of callers without a session
+    // whose buckets have refilled, since a new one would be no different.
+    // Called with the lock held for writing.
+    void purge(void)
+    {
+      clock_t::time_point now = clock_t::now();
+      std::unordered_set<const RateLimiter*> inUse;
+      for (auto session = sessions_.begin(); session != sessions_.end();) {
+        if (session->second.expiry <= now) {
+          session = sessions_.erase(session);
+        } else {
+          inUse.insert(session->second.limiter);
+          ++session;
+        }
+      }
+      for (auto limiter = limiters_.begin(); limiter != limiters_.end();) {
+        if (!inUse.count(limiter->second.get()) &&
+            limiter->second->isFull(now)) {
+          limiter = limiters_.erase(limiter);
+        } else {
+          ++limiter;
+        }
+      }
+      purgeAt_ = std::max(kFirstPurge,
+                          2 * std::max(sessions_.size(), limiters_.size()));
+    }
+
     std::shared_ptr<Door> door_;
+    double rate_;
+    double burst_;
+    std::chrono::seconds sessionLifetime_;
+
+    std::shared_mutex mutex_;
+    std::unordered_map<std::uint64_t, Session> sessions_;
+    std::unordered_map<std::string, std::unique_ptr<RateLimiter>> limiters_;
+    RateLimiter passwordLimiter_;
+    std::random_device random_;
+    std::size_t purgeAt_;
 };
 
 int main()
@@ -63,5 +369,66 @@ int main()
   securedDoor.open("Bond007"); // Output: Opening lab door
   securedDoor.close(); // Output: Closing lab door
 
+  // Log in once, then open the door with the token.
+  std::uint64_t token = securedDoor.login("Bond", "Bond007");
+  assert(token != 0);
+  std::uint64_t rejected = securedDoor.login("Bond", "invalid");
+  assert(rejected == 0);
+  securedDoor.open(token); // Output: Opening lab door
+  securedDoor.open(token + 1); // Output: No way, Jose!
+
+  // A caller gets a burst of 10 attempts, logins included, then has to wait.
+  for (int i = 3; i < 10; ++i) {
+    bool opened = securedDoor.open(token); // Output: Opening lab door
+    assert(opened);
+  }
+  securedDoor.open(token); // Output: Not so fast, Jose!
+  securedDoor.logout(token);
+  securedDoor.open(token); // Output: No way, Jose!
+
+  // A lazy door is only built when it is first needed, once, however many
+  // callers need it at the same time.
+  std::atomic<int> builds(0);
+  LazyDoor::factory_t buildLabDoor = [&builds]() {
+    ++builds;
+    return std::make_shared<LabDoor>();
+  };
+  std::shared_ptr<LazyDoor> lazyDoor = std::make_shared<LazyDoor>(buildLabDoor);
+  SecuredDoor lazySecuredDoor(lazyDoor);
+  assert(!lazyDoor->isReady());
+  std::vector<std::thread> callers;
+  std::vector<Door*> doors(4);
+  for (std::size_t i = 0; i < doors.size(); ++i) {
+    callers.emplace_back([&lazyDoor, &doors, i]() {
+      doors[i] = &lazyDoor->getDoor();
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  assert(builds == 1);
+  assert(std::count(doors.begin(), doors.end(), doors[0]) == 4);
+  lazySecuredDoor.open("Bond007"); // Output: Opening lab door
+
+  // Or built in the background ahead of time.
+  LazyDoor warmDoor(buildLabDoor);
+  warmDoor.warmUp();
+  warmDoor.open(); // Output: Opening lab door
+  assert(builds == 2);
+
+  // A door that could not be built is tried again on the next warm-up.
+  std::atomic<int> attempts(0);
+  LazyDoor flakyDoor([&attempts]() -> std::shared_ptr<Door> {
+    if (++attempts == 1) {
+      return nullptr;
+    }
+    return std::make_shared<LabDoor>();
+  });
+  while (!flakyDoor.isReady()) {
+    flakyDoor.warmUp();
+    std::this_thread::yield();
+  }
+  assert(attempts == 2);
+
   return 0;
 }